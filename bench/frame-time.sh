@@ -0,0 +1,66 @@
+#!/bin/sh
+
+# Copyright 2023 Elijah Gordon (SLcK) <braindisassemblue@gmail.com>
+
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# Times how long illumiterm takes to run "cat largefile", and prints its frame times as well when it
+# has --frame-stats. Only the shell is replaced, so the baseline build and every later one can be
+# compared the same way:
+#
+#   bench/frame-time.sh ./old/src/illumiterm
+#   bench/frame-time.sh ./src/illumiterm
+#
+# Usage: frame-time.sh [ILLUMITERM [SIZE_MIB]]
+
+set -eu
+
+illumiterm=${1:-illumiterm}
+size=${2:-256}
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT INT TERM
+
+# Printable lines of 76 characters, like dense log output
+head -c $((size * 1024 * 768)) /dev/urandom | base64 > "$workdir/largefile"
+
+# Every build runs $SHELL in its first tab; this one prints the file and exits, which closes the window
+cat > "$workdir/shell" <<EOF
+#!/bin/sh
+exec cat '$workdir/largefile'
+EOF
+chmod +x "$workdir/shell"
+
+# Builds from before --frame-stats would reject the option
+options=
+if "$illumiterm" --help-all 2> /dev/null | grep -q -- --frame-stats; then
+    options=--frame-stats
+fi
+
+# Run in a bus session of its own so an already running illumiterm does not take the command line,
+# and under Xvfb when there is no display
+run="$illumiterm"
+if command -v dbus-run-session > /dev/null; then
+    run="dbus-run-session -- $run"
+fi
+if [ -z "${DISPLAY:-}" ] && [ -z "${WAYLAND_DISPLAY:-}" ]; then
+    run="xvfb-run -a $run"
+fi
+
+start=$(date +%s.%N)
+SHELL="$workdir/shell" $run $options
+end=$(date +%s.%N)
+
+awk -v size="$size" -v start="$start" -v end="$end" 'BEGIN { printf "%d MiB in %.2f s\n", size, end - start }'
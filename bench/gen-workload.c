@@ -0,0 +1,169 @@
+/* Copyright 2023 Elijah Gordon (SLcK) <braindisassemblue@gmail.com>
+
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Writes a terminal output workload of a given size to stdout, see bench/run.sh.
+// The output is deterministic so runs of different builds see the same bytes.
+//
+// Usage: gen-workload ascii|color|unicode|cursor SIZE_MIB
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Screen size the cursor workload moves around in
+#define ROWS 24
+#define COLUMNS 80
+
+static uint32_t state = 1;
+
+static uint32_t next_random() {
+    // Small xorshift generator, good enough to keep the output from repeating
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static size_t put_utf8(char *out, uint32_t c) {
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    } else if (c < 0x800) {
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    } else if (c < 0x10000) {
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+
+    out[0] = 0xf0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3f);
+    out[2] = 0x80 | ((c >> 6) & 0x3f);
+    out[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+static size_t ascii_line(char *out) {
+    // Printable lines of varying length, like log output
+    size_t length = 20 + next_random() % (COLUMNS - 20);
+
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = ' ' + next_random() % 95;
+    }
+    out[length] = '\n';
+
+    return length + 1;
+}
+
+static size_t color_line(char *out) {
+    // Every cell gets its own 256-color foreground and background
+    size_t length = 0;
+
+    for (int i = 0; i < COLUMNS; ++i) {
+        length += sprintf(out + length, "\033[38;5;%u;48;5;%um%c", next_random() % 256, next_random() % 256, '!' + next_random() % 94);
+    }
+    length += sprintf(out + length, "\033[0m\n");
+
+    return length;
+}
+
+static size_t unicode_line(char *out) {
+    // Double-width CJK and emoji, with some combining marks on Latin letters
+    size_t length = 0;
+
+    for (int i = 0; i < COLUMNS / 2; ++i) {
+        switch (next_random() % 4) {
+            case 0:
+                length += put_utf8(out + length, 0x1f600 + next_random() % 80);
+                break;
+            case 1:
+                length += put_utf8(out + length, 'a' + next_random() % 26);
+                length += put_utf8(out + length, 0x0300 + next_random() % 0x70);
+                break;
+            default:
+                length += put_utf8(out + length, 0x4e00 + next_random() % 0x5000);
+                break;
+        }
+    }
+    out[length++] = '\n';
+
+    return length;
+}
+
+static size_t cursor_line(char *out) {
+    // Jump around the screen writing single characters, clearing it now and then
+    size_t length = 0;
+
+    for (int i = 0; i < 16; ++i) {
+        length += sprintf(out + length, "\033[%u;%uH%c", 1 + next_random() % ROWS, 1 + next_random() % COLUMNS, 'A' + next_random() % 26);
+    }
+    if (next_random() % 64 == 0) {
+        length += sprintf(out + length, "\033[2J");
+    }
+
+    return length;
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        const char *name;
+        size_t (*line)(char *out);
+    } kinds[] = {
+        { "ascii", ascii_line },
+        { "color", color_line },
+        { "unicode", unicode_line },
+        { "cursor", cursor_line },
+    };
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s ascii|color|unicode|cursor SIZE_MIB\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+        if (strcmp(argv[1], kinds[k].name) != 0) {
+            continue;
+        }
+
+        uint64_t remaining = strtoull(argv[2], NULL, 10) << 20;
+        char line[4096];
+
+        while (remaining > 0) {
+            size_t length = kinds[k].line(line);
+
+            if (length > remaining) {
+                length = remaining;
+            }
+            if (fwrite(line, 1, length, stdout) != length) {
+                perror("gen-workload");
+                return EXIT_FAILURE;
+            }
+            remaining -= length;
+        }
+
+        // Leave the terminal in its normal state
+        fputs("\033[0m\n", stdout);
+        return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%s: unknown workload %s\n", argv[0], argv[1]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#!/bin/sh
+
+# Copyright 2023 Elijah Gordon (SLcK) <braindisassemblue@gmail.com>
+
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# Output throughput benchmark, run by "make bench".
+# Pipes fixed workloads through illumiterm and records throughput, frame times and
+# peak RSS for each of them in a table on stdout and in bench-results.tsv.
+#
+# Environment:
+#   ILLUMITERM          illumiterm binary to measure (default: illumiterm)
+#   GEN_WORKLOAD        workload generator built from bench/gen-workload.c (default: bench/gen-workload)
+#   BENCH_WORKLOADS     workloads to run (default: "ascii color unicode cursor")
+#   BENCH_ASCII_MIB     size of the plain ASCII workload (default: 1024)
+#   BENCH_MIB           size of every other workload (default: 256)
+#   BENCH_RESULTS       results file, appended to (default: bench-results.tsv)
+
+set -eu
+
+illumiterm=${ILLUMITERM:-illumiterm}
+gen_workload=${GEN_WORKLOAD:-bench/gen-workload}
+workloads=${BENCH_WORKLOADS:-ascii color unicode cursor}
+results=${BENCH_RESULTS:-bench-results.tsv}
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT INT TERM
+
+# GNU time reports the peak RSS of the process it runs; it wraps illumiterm alone, as the peak of
+# Xvfb or the bus daemon would otherwise be reported instead
+run="$illumiterm"
+if /usr/bin/time -f %M true > /dev/null 2>&1; then
+    run="/usr/bin/time -o $workdir/rss -f %M $run"
+fi
+
+# Run in a bus session of its own so an already running illumiterm does not take the command line,
+# and under Xvfb when there is no display
+if command -v dbus-run-session > /dev/null; then
+    run="dbus-run-session -- $run"
+fi
+if [ -z "${DISPLAY:-}" ] && [ -z "${WAYLAND_DISPLAY:-}" ]; then
+    run="xvfb-run -a -s '-screen 0 1280x1024x24' $run"
+fi
+
+if [ ! -s "$results" ]; then
+    printf 'date\tcommit\tworkload\tmib\tseconds\tmib_per_s\tframes\tframe_p50_ms\tframe_p99_ms\tpeak_rss_kib\n' > "$results"
+fi
+commit=$(git -C "$(dirname "$0")" describe --always --dirty 2> /dev/null || echo unknown)
+
+printf '%-10s %8s %9s %9s %8s %9s %9s %12s\n' workload MiB seconds MiB/s frames p50-ms p99-ms peak-RSS-KiB
+
+for workload in $workloads; do
+    if [ "$workload" = ascii ]; then
+        size=${BENCH_ASCII_MIB:-1024}
+    else
+        size=${BENCH_MIB:-256}
+    fi
+
+    "$gen_workload" "$workload" "$size" > "$workdir/$workload"
+    rm -f "$workdir/rss"
+
+    start=$(date +%s.%N)
+    eval "$run --frame-stats --cmd \"cat '$workdir/$workload'\"" > "$workdir/stats"
+    end=$(date +%s.%N)
+
+    # frame-stats: N frames, mean X ms, p50 X ms, p99 X ms, max X ms
+    frames=$(sed -n 's/^frame-stats: \([0-9]*\) frames.*/\1/p' "$workdir/stats")
+    p50=$(sed -n 's/^frame-stats: .* p50 \([0-9.]*\) ms.*/\1/p' "$workdir/stats")
+    p99=$(sed -n 's/^frame-stats: .* p99 \([0-9.]*\) ms.*/\1/p' "$workdir/stats")
+    rss=$(cat "$workdir/rss" 2> /dev/null || echo -)
+
+    awk -v workload="$workload" -v size="$size" -v start="$start" -v end="$end" \
+        -v frames="${frames:--}" -v p50="${p50:--}" -v p99="${p99:--}" -v rss="$rss" \
+        -v date="$(date -u +%Y-%m-%dT%H:%M:%SZ)" -v commit="$commit" -v results="$results" 'BEGIN {
+        seconds = end - start
+        printf "%-10s %8d %9.2f %9.1f %8s %9s %9s %12s\n", workload, size, seconds, size / seconds, frames, p50, p99, rss
+        printf "%s\t%s\t%s\t%d\t%.3f\t%.1f\t%s\t%s\t%s\t%s\n", date, commit, workload, size, seconds, size / seconds, frames, p50, p99, rss >> results
+    }'
+
+    rm -f "$workdir/$workload"
+done
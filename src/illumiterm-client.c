@@ -0,0 +1,184 @@
+/* Copyright 2023 Elijah Gordon (SLcK) <braindisassemblue@gmail.com>
+
+*  This program is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License
+*  as published by the Free Software Foundation; either version 2
+*  of the License, or (at your option) any later version.
+
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Minimal launcher for a running "illumiterm --daemon".
+// It links nothing but the C library, sends its working directory, arguments and environment
+// over the daemon socket and exits, so opening a window costs no toolkit initialization.
+// See open_daemon_request in illumiterm.c for the message format.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Name of the socket, matching DAEMON_SOCKET_NAME in illumiterm.c
+#define DAEMON_SOCKET_NAME "illumiterm-daemon.socket"
+
+extern char **environ;
+
+static int get_socket_path(char *path, size_t size) {
+    // Same lookup as g_get_user_runtime_dir: $XDG_RUNTIME_DIR, else the user cache directory
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    const char *cache_dir = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+
+    if (runtime_dir && *runtime_dir) {
+        length = snprintf(path, size, "%s/%s", runtime_dir, DAEMON_SOCKET_NAME);
+    } else if (cache_dir && *cache_dir) {
+        length = snprintf(path, size, "%s/%s", cache_dir, DAEMON_SOCKET_NAME);
+    } else if (home && *home) {
+        length = snprintf(path, size, "%s/.cache/%s", home, DAEMON_SOCKET_NAME);
+    } else {
+        return -1;
+    }
+
+    return length > 0 && (size_t) length < size ? 0 : -1;
+}
+
+static int connect_daemon() {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (get_socket_path(address.sun_path, sizeof(address.sun_path)) < 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int write_all(int fd, const char *buffer, size_t length) {
+    // Write the whole buffer, retrying on short writes and interruptions
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        buffer += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+static int write_record(int fd, char tag, const char *value) {
+    // Each record is a tag character followed by a NUL-terminated value
+    return write_all(fd, &tag, 1) < 0 || write_all(fd, value, strlen(value) + 1) < 0 ? -1 : 0;
+}
+
+static int send_request(int fd, int argc, char **argv) {
+    char cwd[PATH_MAX];
+
+    // Working directory for the new terminal; the daemon falls back to the home directory without one
+    if (getcwd(cwd, sizeof(cwd)) && write_record(fd, 'C', cwd) < 0) {
+        return -1;
+    }
+
+    // Command to run instead of the shell
+    for (int i = 1; i < argc; ++i) {
+        if (write_record(fd, 'A', argv[i]) < 0) {
+            return -1;
+        }
+    }
+
+    // Environment for the new terminal
+    for (char **variable = environ; *variable; ++variable) {
+        if (write_record(fd, 'E', *variable) < 0) {
+            return -1;
+        }
+    }
+
+    // The daemon reads the request up to the end of the stream
+    return shutdown(fd, SHUT_WR);
+}
+
+static char* quote_command(int argc, char **argv) {
+    char *command = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&command, &length);
+
+    if (!stream) {
+        return NULL;
+    }
+
+    // Join the arguments into one command line, each in single quotes for /bin/sh -c
+    for (int i = 1; i < argc; ++i) {
+        fputs(i > 1 ? " '" : "'", stream);
+        for (const char *c = argv[i]; *c; ++c) {
+            if (*c == '\'') {
+                fputs("'\\''", stream);
+            } else {
+                fputc(*c, stream);
+            }
+        }
+        fputc('\'', stream);
+    }
+
+    fclose(stream);
+    return command;
+}
+
+static void run_fallback(int argc, char **argv) {
+    // Without a daemon, start a regular instance running the same command
+    if (argc == 1) {
+        execlp("illumiterm", "illumiterm", (char *) NULL);
+    } else {
+        char *command = quote_command(argc, argv);
+
+        if (command) {
+            execlp("illumiterm", "illumiterm", "--cmd", command, (char *) NULL);
+            free(command);
+        }
+    }
+
+    perror("illumiterm-client: illumiterm");
+}
+
+int main(int argc, char **argv) {
+    int fd = connect_daemon();
+
+    if (fd < 0) {
+        run_fallback(argc, argv);
+        return EXIT_FAILURE;
+    }
+
+    int status = send_request(fd, argc, argv) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (status != EXIT_SUCCESS) {
+        perror("illumiterm-client");
+    }
+
+    close(fd);
+    return status;
+}
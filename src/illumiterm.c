@@ -18,30 +18,707 @@
 #include <vte/vte.h>
 #include <gtk/gtk.h>
 
+// Only the flags are used, with the regular expressions VTE compiles
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Default number of scrollback lines each terminal keeps in memory
+#define SCROLLBACK_DEFAULT_LINES 10000
+
+// Default budget for the in-memory scrollback of all terminals together, in MiB
+#define SCROLLBACK_DEFAULT_MEMORY_CAP 256
+
+// Rough number of bytes VTE keeps in memory for every scrollback cell
+#define SCROLLBACK_BYTES_PER_CELL 16
+
+// Smallest hot ring a terminal is trimmed to when the memory cap is shared out
+#define SCROLLBACK_MIN_LINES 100
+
+// Scrollback lines an idle background terminal keeps on a critical memory warning, unless --memory-trim-floor says otherwise
+#define MEMORY_TRIM_FLOOR 1000
+
+// Scrollback options of one invocation, applying to every terminal it opens
+typedef struct {
+    // Number of lines each terminal keeps in its hot in-memory ring (-1 means bounded only by the cap)
+    glong lines;
+
+    // Whether lines leaving the screen are also written to a compressed spill file
+    gboolean spill;
+} ScrollbackPolicy;
+
+static const ScrollbackPolicy default_scrollback_policy = {
+    SCROLLBACK_DEFAULT_LINES,
+    FALSE
+};
+
+// Where and how the output of the terminals of one invocation is logged
+typedef struct {
+    // Directory the logs are written to, NULL for the default under the user data directory
+    gchar *directory;
+
+    // Whether every terminal logs from its start, and whether what is typed into it is logged too
+    gboolean all;
+    gboolean input;
+
+    // Size and age after which a log continues in a new file, 0 for no limit
+    guint64 rotate_size;
+    gint64 rotate_time;
+
+    // Whether the files are gzip-compressed
+    gboolean compress;
+} LogPolicy;
+
+static const LogPolicy default_log_policy = {
+    NULL,
+    FALSE,
+    FALSE,
+    (guint64) 64 * 1024 * 1024,
+    (gint64) 60 * 60 * G_USEC_PER_SEC,
+    FALSE
+};
+
+// Upper bound for the hot scrollback of all terminals of the process together, in bytes
+static gsize scrollback_memory_cap = (gsize) SCROLLBACK_DEFAULT_MEMORY_CAP * 1024 * 1024;
+
+// Most rows fetched from a terminal at once when writing its scrollback out, so a long history is
+// copied a bounded piece per main loop iteration rather than all in one string
+#define SPILL_CHUNK_ROWS 1024
+
+// Scrollback lines idle background terminals are trimmed to when memory is critically low
+static gint memory_trim_floor = MEMORY_TRIM_FLOOR;
+
+// Reference-counted environment shared by all terminals spawned from one invocation, together with the
+// options of that invocation. The variable strings are borrowed from their storage instead of being copied
+// for every terminal.
+typedef struct _Environment Environment;
+typedef struct _PasteJob PasteJob;
+typedef struct _SearchIndex SearchIndex;
+typedef struct _SearchJob SearchJob;
+typedef struct _TerminalData TerminalData;
+typedef struct _SessionLog SessionLog;
+
+// What happened in a tab while it was in the background, from least to most worth telling
+typedef enum {
+    TAB_ACTIVITY_NONE,
+    TAB_ACTIVITY_OUTPUT,
+    TAB_ACTIVITY_SILENCE,
+    TAB_ACTIVITY_DONE,
+    TAB_ACTIVITY_FAILED
+} TabActivity;
+struct _Environment {
+    gint ref_count;
+
+    // NULL-terminated variables as passed to the child
+    gchar **envv;
+
+    // Whether envv is a vector of its own rather than part of the storage
+    gboolean owns_vector;
+
+    // Owner of the variable strings, released together with the last reference
+    gpointer storage;
+    GDestroyNotify free_storage;
+
+    // Environment the unchanged variables of an overridden environment are borrowed from
+    Environment *parent;
+
+    // Scrollback and logging options of the invocation
+    ScrollbackPolicy scrollback;
+    LogPolicy log;
+};
+
+// Factor between two zoom steps, and the range VTE keeps the font scale in
+#define FONT_SCALE_STEP 1.125
+#define FONT_SCALE_MIN 0.25
+#define FONT_SCALE_MAX 4.0
+
+// Cell size of a font at one font scale, shared by all terminals using that font
+typedef struct {
+    // Character cell size as measured by a terminal, 0 until one has used this scale
+    glong char_width;
+    glong char_height;
+} FontMetrics;
+
+// Font metrics by font description and scale, shared by all windows of the process, and how often
+// a terminal found the cell size of its font there
+static GHashTable *font_metrics_cache = NULL;
+static guint64 font_metrics_hits = 0;
+
+// Per-window state, attached to each window with the "window-data" key
+typedef struct {
+    // The top-level window
+    GtkWidget *window;
+
+    // Notebook holding one page per tab
+    GtkWidget *notebook;
+
+    // Tick callback applying the pending title changes of the window's tabs at the next frame, or 0
+    guint title_tick;
+
+    // Whether the window is minimized or withdrawn, so that none of its terminals is rendered, and whether
+    // its updates are frozen for that
+    gboolean suspended;
+    gboolean suspend_frozen;
+
+    // Whether closing the window keeps its terminals running until --attach opens them in a new window, as
+    // asked with --detach by the command line that opened it, and whether it is closing with its tabs being detached
+    gboolean detach;
+    gboolean detaching;
+
+    // Dialog asking whether to close the window while programs run in it, or NULL, and whether it was answered with Yes
+    GtkWidget *confirm_dialog;
+    gboolean close_confirmed;
+
+    // While a shown terminal floods, the timeout letting one frame through every FLOOD_FRAME_INTERVAL,
+    // and whether updates of the window are currently frozen
+    guint frame_cap_source;
+    gboolean frame_cap_frozen;
+
+    // Find bar below the notebook, its query entry, regex switch and match count, and the search running, or NULL
+    GtkWidget *find_bar;
+    GtkWidget *find_entry;
+    GtkWidget *find_regex;
+    GtkWidget *find_status;
+    SearchJob *search_job;
+
+    // Context menu of the window's terminals, built on the first right-click
+    GtkWidget *context_menu;
+
+    // Context menu items whose sensitivity follows the terminal state
+    GtkWidget *copy_item;
+    GtkWidget *previous_tab_item;
+    GtkWidget *next_tab_item;
+    GtkWidget *move_tab_left_item;
+    GtkWidget *move_tab_right_item;
+
+    // With --frame-stats, when the frame being painted started and how long each painted frame took, in microseconds
+    gint64 frame_start;
+    GArray *frame_times;
+
+    // With --trace-latency, the id of the terminal that got the oldest keystroke still waiting to be painted,
+    // when the key was pressed and when the terminal contents changed in response, or 0
+    guint latency_terminal;
+    gint64 latency_key_time;
+    gint64 latency_output_time;
+
+    // Number identifying the window in the session log, and the size last recorded there
+    guint session_id;
+    gint session_width;
+    gint session_height;
+} WindowData;
+
+// Most bytes read from the child's PTY per main loop iteration
+#define PTY_CHUNK_SIZE 65536
+
+// Output read from the child but not yet taken by VTE beyond which reading waits until VTE took it
+#define PTY_BACKLOG_LIMIT (4 * PTY_CHUNK_SIZE)
+
+// Bytes queued for a PTY and written as fast as the other side reads them: the child's input, keyboard
+// input and replies VTE commits, pastes and broadcasts alike, and the child's output on its way to VTE
+typedef struct {
+    gint fd;
+
+    // Bytes queued, of which those before offset have been written; the buffer only moves when it is emptied
+    // or mostly written
+    GByteArray *buffer;
+    guint offset;
+
+    // Source watching fd for room to write, or 0
+    guint source;
+
+    // Called whenever everything queued has been written, or NULL
+    GDestroyNotify drained;
+    gpointer user_data;
+} PtyWriter;
+
+// Child output read from its PTY and passed on to the relay PTY VTE reads; VTE reads the relay only as
+// fast as it parses, so waiting for the relay to take the output bounds what VTE has queued
+typedef struct {
+    gint fd;
+
+    // Source watching fd for output, or 0 while the relay is full and once the end was reached
+    guint source;
+
+    // Priority the source is dispatched at
+    gint priority;
+
+    // Called with the bytes read each time, before they go to the relay
+    void (*received)(gpointer user_data, const guint8 *bytes, gsize count);
+    gpointer user_data;
+    PtyWriter *relay;
+
+    // Whether fd reached its end, and the bytes read from it so far
+    gboolean eof;
+    guint64 bytes;
+} PtyReader;
+
+// Per-tab state, attached to each notebook page (and its VteTerminal once created) with the "terminal-data" key
+struct _TerminalData {
+    // The terminal widget, NULL until the tab is shown for the first time
+    VteTerminal *terminal;
+
+    // The notebook page holding the terminal; for a split pane, the box holding it inside the tab's page
+    GtkWidget *page;
+
+    // Box holding the terminal and its scrollbar, the page itself until the tab is first split
+    GtkWidget *pane;
+
+    // For a split pane, the tab it belongs to and shares its label, title and session entry with, else NULL
+    TerminalData *tab;
+
+    // In a tab, its split panes, and the one that last had the focus, or NULL for the tab's own terminal
+    GList *panes;
+    TerminalData *active_pane;
+
+    // The label shown in the tab
+    GtkWidget *label;
+
+    // The window the tab belongs to
+    GtkWidget *window;
+
+    // Working directory, argument vector and environment the terminal is spawned with, and whether that
+    // runs the user's shell rather than a command
+    gchar *cwd;
+    gchar **argv;
+    Environment *environment;
+    gboolean login_shell;
+
+    // Name given with "Name Tab", overriding the terminal title in the tab label
+    gchar *custom_title;
+
+    // Whether the terminal title changed since the tab label and window title were last updated
+    gboolean title_pending;
+
+    // In a tab, what its terminals did since it was last shown, when they last wrote, and the timeout
+    // checking whether they went silent, or 0
+    TabActivity activity;
+    gint64 last_output_time;
+    guint silence_source;
+
+    // Progress through a shell integration sequence marking the end of a command, and its exit status so far
+    guint command_end_match;
+    gint command_status;
+
+    // Idle source measuring the cell size of the neighbouring zoom steps
+    guint font_measure_source;
+
+    // Number identifying the terminal in the stats interface, unique within the process
+    guint id;
+
+    // PTY the child runs on; this process reads its output so it can be accounted for, and writes what VTE
+    // commits back to it. VTE reads the output from a raw relay PTY of its own, whose other side is
+    // relay_fd, and what VTE writes to the relay is dropped, as it came through "commit" already
+    VtePty *pty;
+    PtyReader output;
+    PtyWriter input;
+    VtePty *relay;
+    gint relay_fd;
+    PtyWriter relay_output;
+    guint relay_input_source;
+
+    // Source waiting for the child to exit, or 0
+    guint child_watch;
+
+    // Whether keyboard input and pastes are sent to the other terminals of the broadcast group too, whether a
+    // paste of this terminal is being broadcast, and whether one broadcast to it was wrapped in bracketed paste
+    // markers and is not closed yet
+    gboolean broadcasting;
+    gboolean broadcast_pasting;
+    gboolean broadcast_bracketed;
+
+    // Log the child's output is recorded to, or NULL
+    SessionLog *log;
+
+    // Size last applied to the child PTY, and the tick callback applying a new one at the next frame, or 0
+    glong pty_rows;
+    glong pty_columns;
+    guint pty_size_tick;
+
+    // Whether the tab has been started; a pooled terminal has its widget and PTYs ready before that, and
+    // possibly its shell
+    gboolean started;
+
+    // Cancels spawning the child when the terminal goes away first
+    GCancellable *spawn_cancellable;
+
+    // Child process, recorded once it has been spawned, or 0
+    GPid child_pid;
+
+    // Frames the terminal has drawn
+    guint64 frames_drawn;
+
+    // Whether the terminal is kept unmapped because it cannot be seen; it still reads its PTY into the scrollback
+    gboolean throttled;
+
+    // Whether the child writes so fast that the window is only rendered every FLOOD_FRAME_INTERVAL
+    gboolean flooding;
+
+    // Start of the current output rate sample, bytes received since then, and consecutive samples above the threshold
+    gint64 flood_sample_start;
+    guint64 flood_sample_bytes;
+    guint flood_samples;
+
+    // Timeout sampling the output rate while flooding, so that the end of the flood is noticed even when output stops
+    guint flood_source;
+
+    // Whether the child switched bracketed paste on, and where in a sequence that may switch it the output last
+    // ended: how far it got, the mode number being read and whether bracketed paste was among those before it
+    gboolean bracketed_paste;
+    guint bracketed_paste_state;
+    guint bracketed_paste_mode;
+    gboolean bracketed_paste_listed;
+
+    // Paste being written to the child, or NULL
+    PasteJob *paste;
+
+    // Snapshots of the scrollback kept between searches, or NULL before the first one
+    SearchIndex *search_index;
+
+    // History chunks of the tab in the session log (SessionChunk); until the terminal is created they are
+    // the history restored from the last session, fed to it before the child starts
+    GArray *session_chunks;
+
+    // Number of scrollback lines currently applied to the terminal, and the limit memory pressure put on
+    // it while it is in the background, or 0
+    glong scrollback_lines;
+    glong scrollback_limit;
+
+    // Compressed spill file receiving the lines that leave the screen, or NULL, the bytes of text written to it,
+    // and the rows they are, from the first up to the one after the last
+    gzFile spill_file;
+    gsize spill_length;
+    glong spill_first_row;
+    glong spill_end_row;
+
+    // Path of the spill file, removed again when the terminal goes away
+    gchar *spill_path;
+
+    // First absolute row that has not been written to the spill file yet
+    glong spilled_row;
+
+    // Idle source that flushes new rows to the spill file
+    guint spill_source;
+};
+
+// All live terminals of the process, used to share out the scrollback memory cap
+static GList *terminals = NULL;
+
+// Output rate above which a terminal is flooding, in bytes per second, measured over samples of
+// FLOOD_SAMPLE_INTERVAL milliseconds; FLOOD_SAMPLES samples in a row start flood mode, one below ends it
+#define FLOOD_RATE (16 * 1024 * 1024)
+#define FLOOD_SAMPLE_INTERVAL 250
+#define FLOOD_SAMPLES 2
+
+// Time between the frames of a window rendering a flooding terminal, in milliseconds
+#define FLOOD_FRAME_INTERVAL 100
+
+// Largest amount of pasted text queued for the child at once, and size from which a paste shows its progress
+#define PASTE_CHUNK_SIZE 65536
+#define PASTE_PROGRESS_THRESHOLD (256 * 1024)
+
+// Sequence switching bracketed paste mode, followed by 'h' or 'l', and the markers wrapping pasted text in it
+#define BRACKETED_PASTE_MODE 2004
+#define BRACKETED_PASTE_START "\033[200~"
+#define BRACKETED_PASTE_END "\033[201~"
+
+// Input a broadcast target may leave unread before it is dropped from the group
+#define BROADCAST_BUFFER_LIMIT (16 * PTY_BACKLOG_LIMIT)
+
+// Label prefix of tabs in the broadcast group
+#define BROADCAST_LABEL_PREFIX "\u00bb "
+
+// Label prefixes of background tabs, by TabActivity
+static const gchar *const tab_activity_prefixes[] = { "", "\u2022 ", "\u2026 ", "\u2713 ", "\u2717 " };
+
+// Start of the shell integration sequence (OSC 133 ; D) a shell sends when a command finished, followed by
+// an optional ";" and exit status up to BEL or ST
+#define COMMAND_END_SEQUENCE "\033]133;D"
+
+// Identifier given to the next terminal created
+static guint next_terminal_id = 1;
+
+// A chunk of scrollback history stored in the session log: where its record starts, the size of the
+// whole record and the size of the text once inflated
+typedef struct {
+    goffset offset;
+    guint32 length;
+    guint32 text_length;
+} SessionChunk;
+
+// All open windows, in the order they were opened
+static GList *windows = NULL;
+
+// Identifier given to the next window created
+static guint next_window_id = 1;
+
+// Number of ready terminals kept for New Window and New Tab
+#define TERMINAL_POOL_SIZE 2
+
+// Ready tabs with their widget and PTYs, not attached to any window yet
+static GQueue terminal_pool = G_QUEUE_INIT;
+
+// Directory and environment of the last tab opened with the shell; pooled terminals have that shell running
+// already, for the next tab asking for the same
+static gchar *terminal_pool_cwd = NULL;
+static Environment *terminal_pool_environment = NULL;
+
+// Idle source refilling the pool in the background
+static guint terminal_pool_source = 0;
+
+// Terminals of closed windows waiting to be attached again, each holding the application
+static GList *detached_terminals = NULL;
+
+// Whether windows record their frame times and print them when closed (--frame-stats)
+static gboolean frame_stats_enabled = FALSE;
+
+// Phases of opening a window timed by --profile-startup, with the names they are reported under
+typedef enum {
+    STARTUP_GTK_INIT,
+    STARTUP_WIDGET_BUILD,
+    STARTUP_FONT_SETUP,
+    STARTUP_SPAWN,
+    STARTUP_FIRST_PAINT,
+    STARTUP_PHASES
+} StartupPhase;
+
+static const gchar *startup_phase_names[STARTUP_PHASES] = { "gtk-init", "widget-build", "font-setup", "spawn", "first-paint" };
+
+// Seconds a timed window may take to show its first frame before the profile is reported without it
+#define STARTUP_PROFILE_TIMEOUT 30
+
+// With --profile-startup, the command line to report to, the tab whose terminal is timed and its window (only
+// compared once claimed, never dereferenced), when the command line started, when each phase started and
+// ended, in microseconds, which phases a pooled or reattached terminal had done before the window was opened,
+// and the source giving up on the first frame
+typedef struct {
+    GApplicationCommandLine *cli;
+    gpointer tab;
+    gpointer window;
+    gint64 origin;
+    gint64 start[STARTUP_PHASES];
+    gint64 end[STARTUP_PHASES];
+    gboolean ready[STARTUP_PHASES];
+    guint timeout;
+} StartupProfile;
+
+// The window being timed, or NULL; one at a time, as the phases of overlapping windows would mix
+static StartupProfile *startup_profile = NULL;
+
+// When the process started and when the toolkit was initialized, which only the primary instance's own window shows
+static gint64 process_start_time = 0;
+static gint64 gtk_init_time = 0;
+
+// Title changes received from terminals, and how many of them never reached a label or window title
+// because they were coalesced into a later change of the same frame or did not change the text
+static guint64 title_updates_requested = 0;
+static guint64 title_updates_dropped = 0;
+
+// Width of one latency histogram bucket and number of buckets, in microseconds; slower samples go to the last bucket
+#define LATENCY_BUCKET_WIDTH 100
+#define LATENCY_BUCKETS 2500
+
+// Time after which a keystroke that changed nothing on screen stops waiting for its output, in microseconds
+#define LATENCY_TIMEOUT G_USEC_PER_SEC
+
+// Fixed-size latency histogram, so tracing a long session costs no more memory than a short one
+typedef struct {
+    guint64 buckets[LATENCY_BUCKETS + 1];
+    guint64 count;
+    gint64 max;
+} LatencyHistogram;
+
+// Whether keystrokes are timed until their output is painted (--trace-latency)
+static gboolean latency_trace_enabled = FALSE;
+
+// Time from a keystroke to the terminal contents changing (child, PTY and network), from that change to the
+// end of the next painted frame (terminal and toolkit), and the two together
+static LatencyHistogram latency_input_to_output;
+static LatencyHistogram latency_output_to_paint;
+static LatencyHistogram latency_input_to_paint;
+
+// Keystrokes that were not followed by any output within LATENCY_TIMEOUT
+static guint64 latency_unanswered = 0;
+
+// Socket service answering every connection with the current latency report, and the path it listens on
+static GSocketService *latency_service = NULL;
+static gchar *latency_socket_path = NULL;
+
+// Name of the daemon socket in the user runtime directory, shared with illumiterm-client.c
+#define DAEMON_SOCKET_NAME "illumiterm-daemon.socket"
+
+// Socket service accepting illumiterm-client requests in daemon mode, the path it listens on, and whether the
+// windows it opens keep their terminals when closed and how they log, as the last --daemon asked
+static GSocketService *daemon_service = NULL;
+static gchar *daemon_socket_path = NULL;
+static gboolean daemon_detach = FALSE;
+static LogPolicy daemon_log_policy = { NULL };
+
 // This function retrieves the window title of a VteTerminal widget.
 // It returns the window title as a string.
 static const gchar* get_new_window_title(VteTerminal* terminal) {
     return vte_terminal_get_window_title(terminal);
 }
 
-// This function sets the window title of a GTK window.
+// This function sets the window title of a GTK window, and returns whether it changed.
 // It takes a GtkWidget* representing the window and a const gchar* representing the new title.
-static void set_window_title(GtkWidget* window, const gchar* new_title) {
+static gboolean set_window_title(GtkWidget* window, const gchar* new_title) {
+    // Setting the same title again would still cost a window manager round trip
+    if (g_strcmp0(gtk_window_get_title(GTK_WINDOW(window)), new_title) == 0) {
+        return FALSE;
+    }
+
     // Call the gtk_window_set_title function to set the window title.
     // It takes a GtkWindow* as the first argument, so we cast the GtkWidget* to GtkWindow* using GTK_WINDOW macro.
     gtk_window_set_title(GTK_WINDOW(window), new_title);
+    return TRUE;
+}
+
+// This function retrieves the per-window state stored on a window.
+static WindowData* get_window_data(GtkWidget* window) {
+    return g_object_get_data(G_OBJECT(window), "window-data");
+}
+
+// This function returns the title shown for a tab: the name given with "Name Tab", the terminal title or a fallback.
+static const gchar* get_tab_title(TerminalData* data) {
+    // A name given by the user always wins
+    if (data->custom_title) {
+        return data->custom_title;
+    }
+
+    // Otherwise use the title set by the program running in the pane that has the focus
+    VteTerminal* terminal = data->active_pane ? data->active_pane->terminal : data->terminal;
+    const gchar* title = terminal ? get_new_window_title(terminal) : NULL;
+
+    return (title && *title) ? title : "Terminal";
+}
+
+// This function checks whether a tab is the page currently shown in its window's notebook.
+static gboolean is_current_tab(TerminalData* data) {
+    GtkNotebook* notebook = GTK_NOTEBOOK(get_window_data(data->window)->notebook);
+
+    return gtk_notebook_page_num(notebook, data->page) == gtk_notebook_get_current_page(notebook);
+}
+
+// This function updates the tab label and, for the current tab, the window title, and returns whether either changed.
+static gboolean update_tab_title(TerminalData* data) {
+    // Panes show their title through their tab
+    if (data->tab) {
+        return update_tab_title(data->tab);
+    }
+
+    const gchar* title = get_tab_title(data);
+    gboolean changed = FALSE;
+
+    // Whatever was pending is applied now
+    data->title_pending = FALSE;
+
+    // Pooled terminals have neither a label nor a window yet
+    if (!data->window) {
+        return FALSE;
+    }
+
+    // The tab label always follows the tab title, marked while a pane of the tab broadcasts its input
+    gboolean broadcasting = data->broadcasting;
+    for (GList *pane = data->panes; pane && !broadcasting; pane = pane->next) {
+        broadcasting = ((TerminalData *) pane->data)->broadcasting;
+    }
+    gchar *label = g_strconcat(broadcasting ? BROADCAST_LABEL_PREFIX : "", tab_activity_prefixes[data->activity], title, NULL);
+    if (g_strcmp0(gtk_label_get_text(GTK_LABEL(data->label)), label) != 0) {
+        gtk_label_set_text(GTK_LABEL(data->label), label);
+        changed = TRUE;
+    }
+    g_free(label);
+
+    // The window title follows the tab that is shown
+    if (is_current_tab(data)) {
+        changed |= set_window_title(data->window, title);
+    }
+
+    return changed;
+}
+
+// This function applies the title changes of a window's tabs that came in since the last frame.
+static gboolean flush_title_updates(GtkWidget* window, GdkFrameClock* clock, gpointer user_data) {
+    WindowData* window_data = user_data;
+    GtkNotebook* notebook = GTK_NOTEBOOK(window_data->notebook);
+
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+        TerminalData* data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+
+        // A change that leaves the label and window title as they are was not worth the update
+        if (data->title_pending && !update_tab_title(data)) {
+            title_updates_dropped++;
+        }
+    }
+
+    window_data->title_tick = 0;
+    return G_SOURCE_REMOVE;
 }
 
 // This function is a signal callback that is triggered when the window title of a VteTerminal widget changes.
-// It takes a GtkWidget* representing the widget that emitted the signal (VteTerminal) and a gpointer representing the window.
-static void window_title_changed(GtkWidget* widget, gpointer window) {
-    // Retrieve the new window title by calling the get_new_window_title function.
-    // We cast the GtkWidget* to VteTerminal* using VTE_TERMINAL macro and then call get_new_window_title.
-    const gchar* new_title = get_new_window_title(VTE_TERMINAL(widget));
-    
-    // Set the new window title by calling the set_window_title function.
-    // We pass the window as a gpointer and cast it to GtkWidget* when calling set_window_title.
-    set_window_title(GTK_WIDGET(window), new_title);
+// It takes a GtkWidget* representing the widget that emitted the signal (VteTerminal) and a gpointer representing the tab.
+// This function schedules a tab's label and window title to be updated at the next frame, and returns FALSE if it already was.
+static gboolean request_title_update(TerminalData* data) {
+    // Only the last change before the next frame is shown
+    if (data->title_pending) {
+        return FALSE;
+    }
+    data->title_pending = TRUE;
+
+    // Pooled terminals pick up their title when they are attached to a window
+    if (!data->window) {
+        return TRUE;
+    }
+
+    // Update the tab label and, if the tab is shown, the window title at the next frame
+    WindowData* window_data = get_window_data(data->window);
+    if (!window_data->title_tick) {
+        window_data->title_tick = gtk_widget_add_tick_callback(data->window, flush_title_updates, window_data, NULL);
+    }
+    return TRUE;
+}
+
+static void window_title_changed(GtkWidget* widget, gpointer user_data) {
+    // A pane's title is shown by its tab
+    TerminalData* data = ((TerminalData*) user_data)->tab ? ((TerminalData*) user_data)->tab : user_data;
+    title_updates_requested++;
+
+    if (!request_title_update(data)) {
+        title_updates_dropped++;
+    }
+}
+
+// This function marks what happened in a background tab on its label, unless something more telling already is.
+static void set_tab_activity(TerminalData* data, TabActivity activity) {
+    TerminalData* tab = data->tab ? data->tab : data;
+
+    // New output after a silence means the tab is busy again
+    if (activity > tab->activity || (activity == TAB_ACTIVITY_OUTPUT && tab->activity == TAB_ACTIVITY_SILENCE)) {
+        tab->activity = activity;
+        request_title_update(tab);
+    }
+}
+
+// This function clears the marks of a tab once it is shown.
+static void clear_tab_activity(TerminalData* data) {
+    TerminalData* tab = data->tab ? data->tab : data;
+
+    if (tab->silence_source) {
+        g_source_remove(tab->silence_source);
+        tab->silence_source = 0;
+    }
+    if (tab->activity != TAB_ACTIVITY_NONE) {
+        tab->activity = TAB_ACTIVITY_NONE;
+        request_title_update(tab);
+    }
 }
 
 // This function sets the exit status of a GApplicationCommandLine object.
@@ -86,17 +763,180 @@ static void handle_child_exit(GtkWidget* window, gint status) {
     destroy_and_quit(window, status);
 }
 
-static gboolean child_exited(VteTerminal* term, gint status, gpointer data) {
-    // Cast the data pointer to GtkWidget* since it represents the window
-    GtkWidget* window = data;
+// Split panes, defined together with the tab actions below
+static void close_pane(TerminalData *data);
 
-    // Call the handle_child_exit function, passing the window and the child process status
-    handle_child_exit(window, status);
+// PTYs and the pool, defined together with the terminal pool below
+static void close_terminal_ptys(TerminalData *data);
+static void schedule_terminal_pool_refill();
+
+// This function closes a tab, and the whole window with the given exit status when it was the last tab.
+static void close_terminal_tab(TerminalData* data, gint status) {
+    GtkWidget* window = data->window;
+
+    // A split pane only takes itself out of its tab
+    if (data->tab) {
+        close_pane(data);
+        return;
+    }
+
+    // A pooled terminal whose shell went away is replaced
+    if (!window && g_queue_remove(&terminal_pool, data)) {
+        close_terminal_ptys(data);
+        gtk_widget_destroy(data->page);
+        g_object_unref(data->page);
+        schedule_terminal_pool_refill();
+        return;
+    }
+
+    // A detached terminal whose shell went away is simply dropped
+    if (!window) {
+        detached_terminals = g_list_remove(detached_terminals, data);
+        g_application_release(g_application_get_default());
+        gtk_widget_destroy(data->page);
+        g_object_unref(data->page);
+        return;
+    }
+
+    GtkNotebook* notebook = GTK_NOTEBOOK(get_window_data(window)->notebook);
+
+    // Destroying the page removes it from the notebook and terminates its child process
+    gtk_widget_destroy(data->page);
+
+    // Close the window together with its last tab
+    if (gtk_notebook_get_n_pages(notebook) == 0) {
+        handle_child_exit(window, status);
+    }
+}
+
+static gboolean child_exited(VteTerminal* term, gint status, gpointer data) {
+    // Close the tab whose child exited, passing the child process status
+    close_terminal_tab(data, status);
 
     // Return TRUE to indicate that the child exit event has been handled
     return TRUE;
 }
 
+static FontMetrics* lookup_font_metrics(VteTerminal *terminal, gdouble scale) {
+    if (!font_metrics_cache) {
+        font_metrics_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    // Key by the font and by the scale rounded enough that repeated zoom steps land on the same entry
+    const PangoFontDescription *font = vte_terminal_get_font(terminal);
+    gchar *description = font ? pango_font_description_to_string(font) : g_strdup("");
+    gchar *key = g_strdup_printf("%s@%.4f", description, scale);
+    g_free(description);
+
+    FontMetrics *metrics = g_hash_table_lookup(font_metrics_cache, key);
+    if (metrics) {
+        g_free(key);
+        return metrics;
+    }
+
+    metrics = g_new0(FontMetrics, 1);
+    g_hash_table_insert(font_metrics_cache, key, metrics);
+
+    return metrics;
+}
+
+static void get_char_size(VteTerminal *terminal, glong *char_width, glong *char_height) {
+    FontMetrics *metrics = lookup_font_metrics(terminal, vte_terminal_get_font_scale(terminal));
+
+    // The first terminal at a scale measures the cell; every later zoom step to it, in any window, reuses the size
+    if (!metrics->char_width) {
+        metrics->char_width = vte_terminal_get_char_width(terminal);
+        metrics->char_height = vte_terminal_get_char_height(terminal);
+    } else {
+        font_metrics_hits++;
+    }
+
+    *char_width = metrics->char_width;
+    *char_height = metrics->char_height;
+}
+
+// Characters VTE averages the cell width over
+#define FONT_MEASURE_CHARACTERS " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"
+
+static glong scale_cell_size(gdouble size, gdouble scale) {
+    // Round up like VTE does when it applies the cell spacing
+    gdouble scaled = size * scale;
+    glong rounded = (glong) scaled;
+
+    return rounded < scaled ? rounded + 1 : rounded;
+}
+
+static void measure_font_scale(VteTerminal *terminal, gdouble scale, FontMetrics *metrics) {
+    const PangoFontDescription *font = vte_terminal_get_font(terminal);
+
+    if (!font) {
+        return;
+    }
+
+    // Scale the font like the terminal would
+    PangoFontDescription *description = pango_font_description_copy(font);
+    gint size = pango_font_description_get_size(description) * scale;
+    if (pango_font_description_get_size_is_absolute(description)) {
+        pango_font_description_set_absolute_size(description, size);
+    } else {
+        pango_font_description_set_size(description, size);
+    }
+
+    // Lay out the characters VTE measures its cell with; only the resulting size is kept, not the fonts
+    PangoLayout *layout = gtk_widget_create_pango_layout(GTK_WIDGET(terminal), FONT_MEASURE_CHARACTERS);
+    PangoRectangle logical;
+    pango_layout_set_font_description(layout, description);
+    pango_layout_get_pixel_extents(layout, NULL, &logical);
+
+    glong count = strlen(FONT_MEASURE_CHARACTERS);
+    metrics->char_width = scale_cell_size((logical.width + count - 1) / count, vte_terminal_get_cell_width_scale(terminal));
+    metrics->char_height = scale_cell_size(logical.height, vte_terminal_get_cell_height_scale(terminal));
+
+    g_object_unref(layout);
+    pango_font_description_free(description);
+}
+
+static gboolean measure_font_scales(gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // The terminal went away while its page is still being torn down
+    if (!data->terminal) {
+        data->font_measure_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    gdouble scale = vte_terminal_get_font_scale(data->terminal);
+    gdouble steps[] = { scale * FONT_SCALE_STEP, scale / FONT_SCALE_STEP };
+
+    // Measure one neighbouring scale per idle iteration, within the range VTE clamps the scale to; a scale
+    // any window of the process measured before costs nothing
+    for (guint i = 0; i < G_N_ELEMENTS(steps); ++i) {
+        if (steps[i] < FONT_SCALE_MIN || steps[i] > FONT_SCALE_MAX) {
+            continue;
+        }
+
+        FontMetrics *metrics = lookup_font_metrics(data->terminal, steps[i]);
+        if (!metrics->char_width) {
+            measure_font_scale(data->terminal, steps[i], metrics);
+            if (metrics->char_width) {
+                return G_SOURCE_CONTINUE;
+            }
+        }
+    }
+
+    data->font_measure_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_font_measuring(VteTerminal *terminal) {
+    TerminalData *data = g_object_get_data(G_OBJECT(terminal), "terminal-data");
+
+    // Know the cell size of the next zoom steps up and down before they are taken
+    if (data && !data->font_measure_source) {
+        data->font_measure_source = g_idle_add_full(G_PRIORITY_LOW, measure_font_scales, data, NULL);
+    }
+}
+
 static void get_terminal_dimensions(VteTerminal *terminal, glong *rows, glong *columns, glong *char_width, glong *char_height) {
     // Retrieve the number of rows in the terminal and store it in the provided 'rows' variable
     *rows = vte_terminal_get_row_count(terminal);
@@ -104,11 +944,8 @@ static void get_terminal_dimensions(VteTerminal *terminal, glong *rows, glong *c
     // Retrieve the number of columns in the terminal and store it in the provided 'columns' variable
     *columns = vte_terminal_get_column_count(terminal);
 
-    // Retrieve the width of a character in the terminal and store it in the provided 'char_width' variable
-    *char_width = vte_terminal_get_char_width(terminal);
-
-    // Retrieve the height of a character in the terminal and store it in the provided 'char_height' variable
-    *char_height = vte_terminal_get_char_height(terminal);
+    // Retrieve the character cell size for the current font scale, measured once per scale
+    get_char_size(terminal, char_width, char_height);
 }
 
 static void get_container_dimensions(GtkWidget *widget, GtkWindow *window, gint *owidth, gint *oheight, glong char_width, glong char_height, glong columns, glong rows) {
@@ -158,18 +995,21 @@ static void adjust_font_size(GtkWidget *widget, GtkWindow *window, gdouble facto
 
     // Adjust the terminal size based on the updated dimensions and container offsets
     adjust_terminal_size(window, rows, columns, char_width, char_height, owidth, oheight);
+
+    // Measure the following steps in the background
+    schedule_font_measuring(terminal);
 }
 
 static void increase_font_size(GtkWidget *widget, gpointer window)
 {
-    // Increase the font size by a factor of 1.125
-    adjust_font_size(widget, GTK_WINDOW(window), 1.125);
+    // Increase the font size by one zoom step
+    adjust_font_size(widget, GTK_WINDOW(window), FONT_SCALE_STEP);
 }
 
 static void decrease_font_size(GtkWidget *widget, gpointer window)
 {
-    // Decrease the font size by dividing it by a factor of 1.125
-    adjust_font_size(widget, GTK_WINDOW(window), 1.0 / 1.125);
+    // Decrease the font size by one zoom step
+    adjust_font_size(widget, GTK_WINDOW(window), 1.0 / FONT_SCALE_STEP);
 }
 
 static void reset_font_scale(VteTerminal *terminal)
@@ -228,7 +1068,12 @@ static void reset_font_size(GtkWidget *widget, GtkWindow *window)
     reset_font_description_size(terminal, default_font_size);
 
     // Resize the terminal window to fit the adjusted terminal size
-    resize_terminal_window(window, terminal, vte_terminal_get_char_width(terminal), vte_terminal_get_char_height(terminal));
+    glong char_width, char_height;
+    get_char_size(terminal, &char_width, &char_height);
+    resize_terminal_window(window, terminal, char_width, char_height);
+
+    // Measure the steps around the reset scale in the background
+    schedule_font_measuring(terminal);
 }
 
 static void reset_window_size(GtkWidget *widget, GtkWindow *window)
@@ -241,46 +1086,491 @@ static void reset_window_size(GtkWidget *widget, GtkWindow *window)
     gtk_window_resize(window, default_width, default_height);
 }
 
-static gboolean key_press_event(GtkWidget *widget, GdkEvent *event, gpointer window)
+// Window and tab actions, defined together with the "File" and "Tabs" menus below
+void on_new_window_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_new_tab_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_close_tab_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_name_tab_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_previous_tab_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_next_tab_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_move_tab_left_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_move_tab_right_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_close_window_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_split_right_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_split_down_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_broadcast_input_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_broadcast_window_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_save_scrollback_activate(GtkMenuItem *menuitem, gpointer user_data);
+void on_log_output_activate(GtkMenuItem *menuitem, gpointer user_data);
+
+// Edit actions, defined together with the "Edit" menu below
+static void on_copy_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_paste_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_clear_scrollback_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_zoom_in_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_zoom_out_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_zoom_reset_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_find_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void on_preferences_activate(GtkMenuItem *menuitem, gpointer user_data);
+static void start_search(WindowData *window_data);
+static void cancel_search(WindowData *window_data);
+
+// An action that can be bound to keys, taking the window it acts on as user data
+typedef struct {
+    // Name of the action in the [keybindings] group of the configuration file
+    const gchar *name;
+
+    // Accelerators used when the configuration file does not set the action, separated by ';'
+    const gchar *defaults;
+
+    // Handler, shared with the menu items of the action
+    void (*activate)(GtkMenuItem *menuitem, gpointer user_data);
+} KeyAction;
+
+static const KeyAction key_actions[] = {
+    { "new-window", "<Control><Shift>n", on_new_window_activate },
+    { "new-tab", "<Control><Shift>t", on_new_tab_activate },
+    { "close-tab", "<Control><Shift>w", on_close_tab_activate },
+    { "close-window", "<Control><Shift>q", on_close_window_activate },
+    { "split-right", "<Control><Shift>e", on_split_right_activate },
+    { "split-down", "<Control><Shift>o", on_split_down_activate },
+    { "broadcast-input", "<Control><Shift>b", on_broadcast_input_activate },
+    { "broadcast-window", "", on_broadcast_window_activate },
+    { "save-scrollback", "<Control><Shift>s", on_save_scrollback_activate },
+    { "log-output", "", on_log_output_activate },
+    { "copy", "<Control><Shift>c", on_copy_activate },
+    { "paste", "<Control><Shift>v", on_paste_activate },
+    { "find", "<Control><Shift>f", on_find_activate },
+    { "clear-scrollback", "", on_clear_scrollback_activate },
+    { "zoom-in", "<Control><Shift>plus", on_zoom_in_activate },
+    { "zoom-out", "<Control><Shift>underscore", on_zoom_out_activate },
+    { "zoom-reset", "<Control><Shift>parenright", on_zoom_reset_activate },
+    { "preferences", "", on_preferences_activate },
+    { "name-tab", "<Control><Shift>i", on_name_tab_activate },
+    { "previous-tab", "<Control>Page_Up", on_previous_tab_activate },
+    { "next-tab", "<Control>Page_Down", on_next_tab_activate },
+    { "move-tab-left", "<Control><Shift>Page_Up", on_move_tab_left_activate },
+    { "move-tab-right", "<Control><Shift>Page_Down", on_move_tab_right_activate },
+};
+
+// First accelerator of each action in key_actions, shown next to its menu items
+typedef struct {
+    guint keyval;
+    GdkModifierType modifiers;
+} KeyAccelerator;
+
+static KeyAccelerator key_action_accelerators[G_N_ELEMENTS(key_actions)];
+
+// Actions by key, see get_keybinding_key
+static GHashTable *keybindings = NULL;
+
+static gint64 get_keybinding_key(guint keyval, GdkModifierType modifiers) {
+    // Only the accelerator modifiers count, and letters match whatever Shift did to them
+    GdkModifierType mask = gtk_accelerator_get_default_mod_mask();
+
+    return ((gint64) (modifiers & mask) << 32) | gdk_keyval_to_lower(keyval);
+}
+
+static gchar* get_config_path() {
+    return g_build_filename(g_get_user_config_dir(), "illumiterm", "illumiterm.conf", NULL);
+}
+
+static GKeyFile* load_config() {
+    // A missing configuration file simply means the defaults
+    GKeyFile *config = g_key_file_new();
+    gchar *path = get_config_path();
+    GError *error = NULL;
+
+    if (!g_key_file_load_from_file(config, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_warning("Unable to read %s: %s", path, error->message);
+        }
+        g_error_free(error);
+    }
+
+    g_free(path);
+    return config;
+}
+
+static void load_keybindings(GKeyFile *config) {
+    if (keybindings) {
+        g_hash_table_remove_all(keybindings);
+    } else {
+        keybindings = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(key_actions); ++i) {
+        const KeyAction *action = &key_actions[i];
+
+        // The configuration file replaces the default accelerators of an action, an empty value unbinds it
+        gchar **accelerators = g_key_file_has_key(config, "keybindings", action->name, NULL) ?
+            g_key_file_get_string_list(config, "keybindings", action->name, NULL, NULL) :
+            g_strsplit(action->defaults, ";", -1);
+
+        key_action_accelerators[i] = (KeyAccelerator) { 0, 0 };
+
+        for (gchar **accelerator = accelerators; accelerator && *accelerator; ++accelerator) {
+            guint keyval;
+            GdkModifierType modifiers;
+
+            if (!*g_strstrip(*accelerator)) {
+                continue;
+            }
+
+            gtk_accelerator_parse(*accelerator, &keyval, &modifiers);
+            if (!keyval) {
+                g_warning("Invalid keybinding \"%s\" for %s", *accelerator, action->name);
+                continue;
+            }
+
+            gint64 *key = g_new(gint64, 1);
+            *key = get_keybinding_key(keyval, modifiers);
+            g_hash_table_insert(keybindings, key, (gpointer) action);
+
+            if (!key_action_accelerators[i].keyval) {
+                key_action_accelerators[i] = (KeyAccelerator) { keyval, modifiers };
+            }
+        }
+
+        g_strfreev(accelerators);
+    }
+}
+
+// Characters counted as part of a word on double click besides letters and digits, unless configured
+#define DEFAULT_WORD_CHAR_EXCEPTIONS "-./?%&_=+@~:"
+
+// Colors of the palette that can be configured
+#define CONFIG_PALETTE_SIZE 16
+
+// Seconds a background tab has to stay quiet to be marked silent, unless configured
+#define DEFAULT_SILENCE_TIMEOUT 10
+
+// Time the configuration file has to stay unchanged before it is read again, in milliseconds
+#define CONFIG_RELOAD_DELAY 200
+
+// Terminal settings from the [terminal] group of the configuration file, shared by all terminals of the process;
+// unset strings, fonts and colors leave VTE's defaults
+typedef struct {
+    gchar *word_char_exceptions;
+    gboolean scroll_on_output;
+    gboolean scroll_on_keystroke;
+    gboolean mouse_autohide;
+    gboolean bold_is_bright;
+    gboolean audible_bell;
+    VteCursorBlinkMode cursor_blink;
+    PangoFontDescription *font;
+
+    gboolean has_foreground;
+    gboolean has_background;
+    gboolean has_cursor_color;
+    GdkRGBA foreground;
+    GdkRGBA background;
+    GdkRGBA cursor_color;
+    GdkRGBA palette[CONFIG_PALETTE_SIZE];
+    gsize palette_size;
+
+    // Seconds without output after which a background tab is marked silent, 0 to never mark it
+    gint silence_timeout;
+} TerminalConfig;
+
+static TerminalConfig terminal_config = {
+    .scroll_on_output = TRUE,
+    .scroll_on_keystroke = TRUE,
+    .mouse_autohide = TRUE,
+    .bold_is_bright = TRUE,
+    .audible_bell = TRUE,
+    .cursor_blink = VTE_CURSOR_BLINK_ON,
+    .silence_timeout = DEFAULT_SILENCE_TIMEOUT,
+};
+
+// Watch on the configuration file, and the timeout reading it again after a change, or 0
+static GFileMonitor *config_monitor = NULL;
+static guint config_reload_source = 0;
+
+static gboolean get_config_boolean(GKeyFile *config, const gchar *key, gboolean fallback) {
+    GError *error = NULL;
+    gboolean value = g_key_file_get_boolean(config, "terminal", key, &error);
+
+    // A missing key keeps the default, an invalid one is reported and keeps it too
+    if (error) {
+        if (!g_error_matches(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND) &&
+            !g_error_matches(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND)) {
+            g_warning("Invalid value for %s: %s", key, error->message);
+        }
+        g_error_free(error);
+        return fallback;
+    }
+
+    return value;
+}
+
+static gboolean get_config_color(GKeyFile *config, const gchar *key, GdkRGBA *color) {
+    gchar *value = g_key_file_get_string(config, "terminal", key, NULL);
+    gboolean valid = value && gdk_rgba_parse(color, g_strstrip(value));
+
+    if (value && !valid) {
+        g_warning("Invalid color \"%s\" for %s", value, key);
+    }
+
+    g_free(value);
+    return valid;
+}
+
+static void parse_terminal_config(GKeyFile *config, TerminalConfig *settings) {
+    *settings = (TerminalConfig) {
+        .word_char_exceptions = g_key_file_get_string(config, "terminal", "word-char-exceptions", NULL),
+        .scroll_on_output = get_config_boolean(config, "scroll-on-output", TRUE),
+        .scroll_on_keystroke = get_config_boolean(config, "scroll-on-keystroke", TRUE),
+        .mouse_autohide = get_config_boolean(config, "mouse-autohide", TRUE),
+        .bold_is_bright = get_config_boolean(config, "bold-is-bright", TRUE),
+        .audible_bell = get_config_boolean(config, "audible-bell", TRUE),
+        .cursor_blink = VTE_CURSOR_BLINK_ON,
+        .silence_timeout = DEFAULT_SILENCE_TIMEOUT,
+    };
+
+    GError *error = NULL;
+    gint silence_timeout = g_key_file_get_integer(config, "terminal", "silence-timeout", &error);
+    if (!error) {
+        settings->silence_timeout = MAX(silence_timeout, 0);
+    } else {
+        if (!g_error_matches(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND) &&
+            !g_error_matches(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND)) {
+            g_warning("Invalid value for silence-timeout: %s", error->message);
+        }
+        g_error_free(error);
+    }
+
+    gchar *blink = g_key_file_get_string(config, "terminal", "cursor-blink", NULL);
+    if (g_strcmp0(blink, "system") == 0) {
+        settings->cursor_blink = VTE_CURSOR_BLINK_SYSTEM;
+    } else if (g_strcmp0(blink, "off") == 0) {
+        settings->cursor_blink = VTE_CURSOR_BLINK_OFF;
+    } else if (blink && g_strcmp0(blink, "on") != 0) {
+        g_warning("Invalid value \"%s\" for cursor-blink, expected system, on or off", blink);
+    }
+    g_free(blink);
+
+    gchar *font = g_key_file_get_string(config, "terminal", "font", NULL);
+    if (font && *font) {
+        settings->font = pango_font_description_from_string(font);
+    }
+    g_free(font);
+
+    settings->has_foreground = get_config_color(config, "foreground", &settings->foreground);
+    settings->has_background = get_config_color(config, "background", &settings->background);
+    settings->has_cursor_color = get_config_color(config, "cursor-color", &settings->cursor_color);
+
+    // VTE takes 8 or 16 palette colors, any other number leaves its palette
+    gsize count = 0;
+    gchar **palette = g_key_file_get_string_list(config, "terminal", "palette", &count, NULL);
+    if (palette && (count == 8 || count == CONFIG_PALETTE_SIZE)) {
+        settings->palette_size = count;
+        for (gsize i = 0; i < count; ++i) {
+            if (!gdk_rgba_parse(&settings->palette[i], g_strstrip(palette[i]))) {
+                g_warning("Invalid palette color \"%s\"", palette[i]);
+                settings->palette_size = 0;
+                break;
+            }
+        }
+    } else if (palette) {
+        g_warning("The palette needs 8 or %d colors, not %" G_GSIZE_FORMAT, CONFIG_PALETTE_SIZE, count);
+    }
+    g_strfreev(palette);
+}
+
+static void clear_terminal_config(TerminalConfig *settings) {
+    g_clear_pointer(&settings->word_char_exceptions, g_free);
+    g_clear_pointer(&settings->font, pango_font_description_free);
+}
+
+static gboolean is_same_config_color(gboolean has_color, const GdkRGBA *color, gboolean had_color, const GdkRGBA *old_color) {
+    return has_color == had_color && (!has_color || gdk_rgba_equal(color, old_color));
+}
+
+static gboolean is_same_config_colors(const TerminalConfig *settings, const TerminalConfig *previous) {
+    if (!is_same_config_color(settings->has_foreground, &settings->foreground, previous->has_foreground, &previous->foreground) ||
+        !is_same_config_color(settings->has_background, &settings->background, previous->has_background, &previous->background) ||
+        settings->palette_size != previous->palette_size) {
+        return FALSE;
+    }
+
+    for (gsize i = 0; i < settings->palette_size; ++i) {
+        if (!gdk_rgba_equal(&settings->palette[i], &previous->palette[i])) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void apply_terminal_config(VteTerminal *terminal, const TerminalConfig *settings, const TerminalConfig *previous) {
+    // Without previous settings everything is applied, otherwise only what changed, so that an unchanged
+    // font is not measured again and a new palette only repaints
+    if (!previous || g_strcmp0(settings->word_char_exceptions, previous->word_char_exceptions) != 0) {
+        vte_terminal_set_word_char_exceptions(terminal, settings->word_char_exceptions ? settings->word_char_exceptions : DEFAULT_WORD_CHAR_EXCEPTIONS);
+    }
+    if (!previous || settings->scroll_on_output != previous->scroll_on_output) {
+        vte_terminal_set_scroll_on_output(terminal, settings->scroll_on_output);
+    }
+    if (!previous || settings->scroll_on_keystroke != previous->scroll_on_keystroke) {
+        vte_terminal_set_scroll_on_keystroke(terminal, settings->scroll_on_keystroke);
+    }
+    if (!previous || settings->mouse_autohide != previous->mouse_autohide) {
+        vte_terminal_set_mouse_autohide(terminal, settings->mouse_autohide);
+    }
+    if (!previous || settings->bold_is_bright != previous->bold_is_bright) {
+        vte_terminal_set_bold_is_bright(terminal, settings->bold_is_bright);
+    }
+    if (!previous || settings->audible_bell != previous->audible_bell) {
+        vte_terminal_set_audible_bell(terminal, settings->audible_bell);
+    }
+    if (!previous || settings->cursor_blink != previous->cursor_blink) {
+        vte_terminal_set_cursor_blink_mode(terminal, settings->cursor_blink);
+    }
+
+    // A new terminal already has VTE's default font and colors
+    gboolean same_font = previous && (settings->font && previous->font ?
+        pango_font_description_equal(settings->font, previous->font) :
+        settings->font == previous->font);
+    if (previous ? !same_font : settings->font != NULL) {
+        vte_terminal_set_font(terminal, settings->font);
+        schedule_font_measuring(terminal);
+    }
+    gboolean colors_set = previous ? !is_same_config_colors(settings, previous) : settings->has_foreground || settings->has_background || settings->palette_size;
+    if (colors_set) {
+        vte_terminal_set_colors(terminal,
+            settings->has_foreground ? &settings->foreground : NULL,
+            settings->has_background ? &settings->background : NULL,
+            settings->palette_size ? settings->palette : NULL,
+            settings->palette_size);
+    }
+
+    // Setting the colors resets the cursor, bold and highlight colors to their defaults, so the cursor color
+    // goes on again after that, and the others are not configured
+    gboolean cursor_set = previous ? !is_same_config_color(settings->has_cursor_color, &settings->cursor_color, previous->has_cursor_color, &previous->cursor_color) : settings->has_cursor_color;
+    if (colors_set ? settings->has_cursor_color : cursor_set) {
+        vte_terminal_set_color_cursor(terminal, settings->has_cursor_color ? &settings->cursor_color : NULL);
+    }
+}
+
+static gboolean reload_config(gpointer user_data) {
+    config_reload_source = 0;
+
+    // Read the file once for all terminals, and keep the settings they have for comparison
+    GKeyFile *config = load_config();
+    TerminalConfig previous = terminal_config;
+    load_keybindings(config);
+    parse_terminal_config(config, &terminal_config);
+    g_key_file_free(config);
+
+    // Only live and pooled terminals are touched, later ones start with the new settings
+    for (GList *item = terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+
+        if (data->terminal) {
+            apply_terminal_config(data->terminal, &terminal_config, &previous);
+        }
+    }
+    for (GList *item = terminal_pool.head; item; item = item->next) {
+        apply_terminal_config(((TerminalData *) item->data)->terminal, &terminal_config, &previous);
+    }
+
+    clear_terminal_config(&previous);
+    return G_SOURCE_REMOVE;
+}
+
+static void config_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event, gpointer user_data) {
+    // Editors write, rename and delete in bursts, read the file once it has settled
+    if (config_reload_source) {
+        g_source_remove(config_reload_source);
+    }
+    config_reload_source = g_timeout_add(CONFIG_RELOAD_DELAY, reload_config, NULL);
+}
+
+static void watch_config() {
+    gchar *path = get_config_path();
+    GFile *file = g_file_new_for_path(path);
+    GError *error = NULL;
+
+    // The file need not exist yet, the monitor also reports its creation
+    config_monitor = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+    if (config_monitor) {
+        g_signal_connect(config_monitor, "changed", G_CALLBACK(config_file_changed), NULL);
+    } else {
+        g_warning("Unable to watch %s: %s", path, error->message);
+        g_error_free(error);
+    }
+
+    g_object_unref(file);
+    g_free(path);
+}
+
+static void trace_keystroke(WindowData *window_data, TerminalData *data, GdkEventKey *event) {
+    // Modifiers alone never produce output
+    if (event->is_modifier) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    // Keep timing from the oldest key that is still waiting, unless it has waited too long for an answer
+    if (window_data->latency_key_time) {
+        if (now - window_data->latency_key_time < LATENCY_TIMEOUT) {
+            return;
+        }
+        if (!window_data->latency_output_time) {
+            latency_unanswered++;
+        }
+    }
+
+    window_data->latency_terminal = data->id;
+    window_data->latency_key_time = now;
+    window_data->latency_output_time = 0;
+}
+
+static gboolean key_press_event(GtkWidget *widget, GdkEvent *event, gpointer user_data)
 {
-    // Get the default modifier mask for accelerators
-    GdkModifierType modifiers = gtk_accelerator_get_default_mod_mask();
+    // The tab the terminal belongs to, and the window holding it
+    TerminalData *data = user_data;
+    WindowData *window_data = get_window_data(data->window);
 
     // Ensure the event type is GDK_KEY_PRESS
     g_assert(event->type == GDK_KEY_PRESS);
 
-    // Check if the key press event matches the specified modifiers
-    if ((event->key.state & modifiers) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) {
-        // Handle key press events with control and shift modifiers
-        switch (event->key.hardware_keycode) {
-            // Key press event for increasing font size (Ctrl+Shift+Page Up)
-            case 21:
-                increase_font_size(widget, window);
-                return TRUE;
-            // Key press event for decreasing font size (Ctrl+Shift+Page Down)
-            case 20:
-                decrease_font_size(widget, window);
-                return TRUE;
-            // Key press event for resetting font size and window size (Ctrl+Shift+Home)
-            case 19:
-                reset_font_size(widget, window);
-                reset_window_size(widget, window);
-                return TRUE;
-        }
-        // Handle key press events without hardware keycode (e.g., letters, symbols)
-        switch (gdk_keyval_to_lower(event->key.keyval)) {
-            // Key press event for copying text to clipboard (Ctrl+Shift+C)
-            case GDK_KEY_c:
-                vte_terminal_copy_clipboard_format((VteTerminal *)widget, VTE_FORMAT_TEXT);
-                return TRUE;
-            // Key press event for pasting text from clipboard (Ctrl+Shift+V)
-            case GDK_KEY_v:
-                vte_terminal_paste_clipboard((VteTerminal *)widget);
-                return TRUE;
-        }
-    }
-    // Return FALSE to indicate that the key press event was not handled
-    return FALSE;
+    // Look the key up among the bound actions
+    gint64 key = get_keybinding_key(event->key.keyval, event->key.state);
+    const KeyAction *action = g_hash_table_lookup(keybindings, &key);
+
+    // Return FALSE to let the terminal handle keys that are not bound
+    if (!action) {
+        // Time the key until the terminal has painted its output
+        if (latency_trace_enabled) {
+            trace_keystroke(window_data, data, &event->key);
+        }
+        return FALSE;
+    }
+
+    // Run the action on the window the terminal belongs to
+    action->activate(NULL, window_data);
+    return TRUE;
+}
+
+static GtkWidget* create_action_menu_item(const gchar *label, const gchar *name, WindowData *window_data) {
+    GtkWidget *item = gtk_menu_item_new_with_label(label);
+
+    for (guint i = 0; i < G_N_ELEMENTS(key_actions); ++i) {
+        if (g_strcmp0(key_actions[i].name, name) != 0) {
+            continue;
+        }
+
+        // The item runs the action and shows the key bound to it
+        g_signal_connect(item, "activate", G_CALLBACK(key_actions[i].activate), window_data);
+        gtk_accel_label_set_accel(GTK_ACCEL_LABEL(gtk_bin_get_child(GTK_BIN(item))),
+                                  key_action_accelerators[i].keyval, key_action_accelerators[i].modifiers);
+        break;
+    }
+
+    return item;
 }
 
 static GtkWidget* create_dialog_buttons() {
@@ -332,7 +1622,7 @@ static GtkWidget* create_dialog_message() {
     return message_label;
 }
 
-static GtkWidget* create_confirm_dialog() {
+static GtkWidget* create_confirm_dialog(GtkWidget **message) {
     // Create a new dialog widget
     GtkWidget* dialog = gtk_dialog_new();
 
@@ -360,8 +1650,9 @@ static GtkWidget* create_confirm_dialog() {
     // Create a message label using the create_dialog_message() function
     GtkWidget* message_label = create_dialog_message();
 
-    // Add the message label to the content area
+    // Add the message label to the content area, and hand it out for the question
     gtk_container_add(GTK_CONTAINER(content_area), message_label);
+    *message = message_label;
 
     // Create dialog buttons using the create_dialog_buttons() function
     GtkWidget* buttons_box = create_dialog_buttons();
@@ -382,46 +1673,118 @@ static void destroy_confirm_dialog(GtkWidget* dialog) {
     gtk_widget_destroy(dialog);
 }
 
-static gboolean get_confirm_response(GtkWidget* dialog) {
-    // Run the dialog and retrieve the response
-    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-
-    // Destroy the dialog widget
-    destroy_confirm_dialog(dialog);
+// Detaching, defined together with the tab actions below
+static void detach_window_tabs(WindowData *window_data);
 
-    // Return TRUE if the response is GTK_RESPONSE_NO, otherwise FALSE
-    return (response == GTK_RESPONSE_NO) ? TRUE : FALSE;
-}
+// Busy terminals, defined together with the context menu below
+static guint count_busy_terminals(WindowData *window_data);
+static void confirm_exit_response(GtkDialog *dialog, gint response, gpointer user_data);
 
 static gboolean confirm_exit(GtkWidget* widget, GdkEvent* event, gpointer data) {
-    // Create a confirm dialog
-    GtkWidget* dialog = create_confirm_dialog();
+    WindowData *window_data = get_window_data(widget);
 
-    // Get the user's response from the confirm dialog
-    return get_confirm_response(dialog);
-}
+    // With --detach nothing is lost, the terminals keep running to be attached again
+    if (window_data->detach) {
+        detach_window_tabs(window_data);
+        return FALSE;
+    }
 
-static GtkWidget* create_context_menu() {
-    GtkWidget *menu = gtk_menu_new();
+    // Asked already, bring the question back up
+    if (window_data->confirm_dialog) {
+        gtk_window_present(GTK_WINDOW(window_data->confirm_dialog));
+        return TRUE;
+    }
 
-    // Create "New Window" menu item
-    GtkWidget *new_window = gtk_menu_item_new_with_label("New Window");
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), new_window);
+    // Close at once when confirmed, or when every shell just waits at its prompt
+    guint busy = window_data->close_confirmed ? 0 : count_busy_terminals(window_data);
+    if (!busy) {
+        return FALSE;
+    }
 
-    // Create "New Tab" menu item
-    GtkWidget *new_tab = gtk_menu_item_new_with_label("New Tab");
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), new_tab);
+    // Ask without running a main loop of our own, the other windows keep going meanwhile; the answer closes
+    // the window again (confirm_exit_response)
+    GtkWidget* label;
+    GtkWidget* dialog = create_confirm_dialog(&label);
+    gchar *message = g_strdup_printf(busy == 1 ?
+        "A program is still running in this window. Close it anyway?" :
+        "%u programs are still running in this window. Close it anyway?", busy);
+    gtk_label_set_text(GTK_LABEL(label), message);
+    g_free(message);
+
+    gtk_window_set_transient_for(GTK_WINDOW(dialog), GTK_WINDOW(widget));
+    gtk_window_set_destroy_with_parent(GTK_WINDOW(dialog), TRUE);
+    g_signal_connect(dialog, "response", G_CALLBACK(confirm_exit_response), window_data);
+    window_data->confirm_dialog = dialog;
+    gtk_widget_show_all(dialog);
 
-    // Create separator item 0
-    GtkWidget *separator0 = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator0);
+    return TRUE;
+}
+
+static gboolean is_terminal_busy(TerminalData *data) {
+    // A tab never shown or whose child is not running yet has nothing to lose
+    if (!data->pty || !data->child_pid) {
+        return FALSE;
+    }
+
+    // The interactive shell is idle while it is the foreground process group of its PTY, as it is at its prompt;
+    // a command run through "sh -c" is what the tab is for, so it counts as busy as long as it runs
+    pid_t group = tcgetpgrp(vte_pty_get_fd(data->pty));
+
+    return group > 0 && (group != data->child_pid || !data->login_shell);
+}
+
+static guint count_busy_terminals(WindowData *window_data) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    guint count = 0;
+
+    // Every tab and pane of the window
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+        TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+
+        count += is_terminal_busy(data);
+        for (GList *pane = data->panes; pane; pane = pane->next) {
+            count += is_terminal_busy(pane->data);
+        }
+    }
+
+    return count;
+}
+
+static void confirm_exit_response(GtkDialog *dialog, gint response, gpointer user_data) {
+    WindowData *window_data = user_data;
+
+    window_data->confirm_dialog = NULL;
+    destroy_confirm_dialog(GTK_WIDGET(dialog));
+
+    // Close for real this time, confirm_exit lets it through
+    if (response == GTK_RESPONSE_YES) {
+        window_data->close_confirmed = TRUE;
+        gtk_window_close(GTK_WINDOW(window_data->window));
+    }
+}
+
+static GtkWidget* create_context_menu(WindowData *window_data) {
+    GtkWidget *menu = gtk_menu_new();
+
+    // Create "New Window" menu item
+    GtkWidget *new_window = create_action_menu_item("New Window", "new-window", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), new_window);
+
+    // Create "New Tab" menu item
+    GtkWidget *new_tab = create_action_menu_item("New Tab", "new-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), new_tab);
+
+    // Create separator item 0
+    GtkWidget *separator0 = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator0);
 
     // Create "Copy" menu item
-    GtkWidget *copy_item = gtk_menu_item_new_with_label("Copy");
+    GtkWidget *copy_item = create_action_menu_item("Copy", "copy", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), copy_item);
+    window_data->copy_item = copy_item;
 
     // Create "Paste" menu item
-    GtkWidget *paste_item = gtk_menu_item_new_with_label("Paste");
+    GtkWidget *paste_item = create_action_menu_item("Paste", "paste", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), paste_item);
 
     // Create separator item 1
@@ -429,7 +1792,7 @@ static GtkWidget* create_context_menu() {
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator1);
 
     // Create "Clear Scrollback" menu item
-    GtkWidget *clear_scrollback = gtk_menu_item_new_with_label("Clear Scrollback");
+    GtkWidget *clear_scrollback = create_action_menu_item("Clear Scrollback", "clear-scrollback", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), clear_scrollback);
 
     // Create separator item 2
@@ -437,777 +1800,6210 @@ static GtkWidget* create_context_menu() {
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator2);
 
     // Create "Preferences" menu item
-    GtkWidget *preferences = gtk_menu_item_new_with_label("Preferences");
+    GtkWidget *preferences = create_action_menu_item("Preferences", "preferences", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), preferences);
 
     // Create "Name Tab" menu item
-    GtkWidget *name_tab = gtk_menu_item_new_with_label("Name Tab");
+    GtkWidget *name_tab = create_action_menu_item("Name Tab", "name-tab", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), name_tab);
 
     // Create "Previous Tab" menu item
-    GtkWidget *previous_tab = gtk_menu_item_new_with_label("Previous Tab");
+    GtkWidget *previous_tab = create_action_menu_item("Previous Tab", "previous-tab", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), previous_tab);
+    window_data->previous_tab_item = previous_tab;
 
     // Create "Next Tab" menu item
-    GtkWidget *next_tab = gtk_menu_item_new_with_label("Next Tab");
+    GtkWidget *next_tab = create_action_menu_item("Next Tab", "next-tab", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), next_tab);
+    window_data->next_tab_item = next_tab;
 
     // Create "Move Tab Left" menu item
-    GtkWidget *move_tab_left = gtk_menu_item_new_with_label("Move Tab Left");
+    GtkWidget *move_tab_left = create_action_menu_item("Move Tab Left", "move-tab-left", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), move_tab_left);
+    window_data->move_tab_left_item = move_tab_left;
 
     // Create "Move Tab Right" menu item
-    GtkWidget *move_tab_right = gtk_menu_item_new_with_label("Move Tab Right");
+    GtkWidget *move_tab_right = create_action_menu_item("Move Tab Right", "move-tab-right", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), move_tab_right);
+    window_data->move_tab_right_item = move_tab_right;
 
     // Create "Close Tab" menu item
-    GtkWidget *close_tab = gtk_menu_item_new_with_label("Close Tab");
+    GtkWidget *close_tab = create_action_menu_item("Close Tab", "close-tab", window_data);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), close_tab);
 
     // Show all menu items
     gtk_widget_show_all(menu);
 
+    // The window owns the menu, which goes away together with it
+    gtk_menu_attach_to_widget(GTK_MENU(menu), window_data->window, NULL);
+
     return menu;
 }
 
+static void update_context_menu(WindowData *window_data, VteTerminal *terminal) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    gint pages = gtk_notebook_get_n_pages(notebook);
+    gint current = gtk_notebook_get_current_page(notebook);
+
+    // Copying needs a selection
+    gtk_widget_set_sensitive(window_data->copy_item, vte_terminal_get_has_selection(terminal));
+
+    // Switching between and moving tabs needs other tabs
+    gtk_widget_set_sensitive(window_data->previous_tab_item, pages > 1);
+    gtk_widget_set_sensitive(window_data->next_tab_item, pages > 1);
+    gtk_widget_set_sensitive(window_data->move_tab_left_item, current > 0);
+    gtk_widget_set_sensitive(window_data->move_tab_right_item, current < pages - 1);
+}
+
 static gboolean button_press_event(GtkWidget *widget, GdkEventButton *event, gpointer data) {
     // Check if the button pressed is not the secondary (right) button
     if (event->button != GDK_BUTTON_SECONDARY) {
         return FALSE;
     }
 
-    // Create a context menu
-    GtkWidget *menu = create_context_menu();
+    // Build the window's context menu once and reuse it afterwards
+    TerminalData *terminal_data = data;
+    WindowData *window_data = get_window_data(terminal_data->window);
+    if (!window_data->context_menu) {
+        window_data->context_menu = create_context_menu(window_data);
+    }
+
+    // Bring the items up to date with the clicked terminal
+    update_context_menu(window_data, VTE_TERMINAL(widget));
 
     // Display the context menu at the pointer's position
-    gtk_menu_popup_at_pointer(GTK_MENU(menu), NULL);
+    gtk_menu_popup_at_pointer(GTK_MENU(window_data->context_menu), (GdkEvent *) event);
 
     // Signal that the event has been handled
     return TRUE;
 }
 
-static gchar** get_environment(GApplicationCommandLine* cli) {
-    // Get the environment from the GApplicationCommandLine
-    const gchar* const* environment = g_application_command_line_get_environ(cli);
-
-    // Calculate the number of environment variables
-    guint num = g_strv_length((gchar**) environment);
-
-    // Allocate memory for the result array with an additional NULL element
-    gchar** result = g_new(gchar*, num + 1);
+static Environment* new_environment(gchar **envv, gboolean owns_vector, gpointer storage, GDestroyNotify free_storage) {
+    // Wrap the variables together with whatever keeps their strings alive
+    Environment *environment = g_new0(Environment, 1);
+    environment->ref_count = 1;
+    environment->envv = envv;
+    environment->owns_vector = owns_vector;
+    environment->storage = storage;
+    environment->free_storage = free_storage;
+    environment->scrollback = default_scrollback_policy;
+    environment->log = default_log_policy;
+
+    return environment;
+}
 
-    // Copy each environment variable to the result array
-    for (guint i = 0; i < num; ++i) {
-        // Duplicate the environment variable string
-        result[i] = g_strdup(environment[i]);
-    }
+static Environment* new_environment_take(gchar **envv) {
+    // The environment owns both the vector and its strings
+    return new_environment(envv, FALSE, envv, (GDestroyNotify) g_strfreev);
+}
 
-    // Set the last element of the result array to NULL
-    result[num] = NULL;
+static Environment* ref_environment(Environment *environment) {
+    environment->ref_count++;
 
-    // Return the resulting array
-    return result;
+    return environment;
 }
 
-static void child_ready(VteTerminal* terminal, GPid pid, GError* error, gpointer user_data) {
-    // Check if the terminal widget is valid
-    if (!terminal) {
+static void unref_environment(Environment *environment) {
+    if (--environment->ref_count > 0) {
         return;
     }
 
-    // Check if the child process identifier is 0, indicating an error
-    if (pid == 0) {
-        // Retrieve the window widget from the user data
-        GtkWidget* window = GTK_WIDGET(user_data);
-
-        // Destroy the window and quit the application, passing the error code
-        destroy_and_quit(window, error->code);
+    // Release the vector, the strings and the environment borrowed from
+    if (environment->owns_vector) {
+        g_free(environment->envv);
+    }
+    if (environment->free_storage) {
+        environment->free_storage(environment->storage);
     }
+    if (environment->parent) {
+        unref_environment(environment->parent);
+    }
+    g_free(environment->log.directory);
+    g_free(environment);
 }
 
-static void connect_child_exited_signal(GtkWidget* widget, GtkWidget* window) {
-    // Connect the "child-exited" signal of the widget to the "child_exited" callback function
-    g_signal_connect(widget, "child-exited", G_CALLBACK(child_exited), window);
-}
+static gboolean is_same_variable(const gchar *variable, const gchar *name) {
+    // Compare the names of two "NAME=VALUE" or "NAME" strings
+    gsize length = strcspn(name, "=");
 
-static void connect_key_press_event_signal(GtkWidget* widget, GtkWidget* window) {
-    // Connect the "key-press-event" signal of the widget to the "key_press_event" callback function
-    g_signal_connect(widget, "key-press-event", G_CALLBACK(key_press_event), window);
+    return strncmp(variable, name, length) == 0 && (variable[length] == '=' || variable[length] == '\0');
 }
 
-static void connect_window_title_changed_signal(GtkWidget* widget, GtkWidget* window) {
-    // Connect the "window-title-changed" signal of the widget to the "window_title_changed" callback function
-    g_signal_connect(widget, "window-title-changed", G_CALLBACK(window_title_changed), window);
-}
+static Environment* override_environment(Environment *base, const gchar * const *overrides) {
+    // Each override is "NAME=VALUE" to set a variable, or "NAME" to remove it.
+    // Only the overrides are copied; every other variable stays borrowed from the base environment.
+    gchar **strings = g_strdupv((gchar **) overrides);
+    GPtrArray *vector = g_ptr_array_new();
 
-static void connect_button_press_event_signal(GtkWidget* widget) {
-    // Connect the "button_press_event" signal of the widget to the "button_press_event" callback function
-    g_signal_connect(widget, "button_press_event", G_CALLBACK(button_press_event), NULL);
+    for (gchar **variable = base->envv; *variable; ++variable) {
+        gboolean overridden = FALSE;
+
+        for (gchar **override = strings; *override && !overridden; ++override) {
+            overridden = is_same_variable(*variable, *override);
+        }
+
+        if (!overridden) {
+            g_ptr_array_add(vector, *variable);
+        }
+    }
+
+    for (gchar **override = strings; *override; ++override) {
+        if (strchr(*override, '=')) {
+            g_ptr_array_add(vector, *override);
+        }
+    }
+    g_ptr_array_add(vector, NULL);
+
+    Environment *environment = new_environment((gchar **) g_ptr_array_free(vector, FALSE), TRUE, strings, (GDestroyNotify) g_strfreev);
+    environment->parent = ref_environment(base);
+    environment->scrollback = base->scrollback;
+    environment->log = base->log;
+    environment->log.directory = g_strdup(base->log.directory);
+
+    return environment;
 }
 
-static void connect_delete_event_signal(GtkWidget* window) {
-    // Connect the "delete-event" signal of the window widget to the "confirm_exit" callback function
-    g_signal_connect(window, "delete-event", G_CALLBACK(confirm_exit), NULL);
+static Environment* get_environment(GApplicationCommandLine* cli) {
+    // Copy the variables once per command line: tabs opened from its tabs share the snapshot long after the
+    // command line is done, and holding the command line itself would keep the invoking process waiting
+    const gchar* const* environment = g_application_command_line_get_environ(cli);
+
+    return new_environment_take(g_strdupv((gchar **) environment));
 }
 
-static void connect_vte_signals(GtkWidget* widget, GtkWidget* window) {
-    // Connect the child-exited signal of the VteTerminal widget to the corresponding handler
-    connect_child_exited_signal(widget, window);
+// Session log written with --session: a magic string, then records of a type byte, the payload length as a
+// little-endian 32-bit number and the payload. While running, records are only ever appended:
+//   'W' window, width, height   a window was opened or resized
+//   'X' window                  a window other than the last one was closed
+//   'T' tab, window, cwd, argv  a tab was opened or changed its directory
+//   'N' tab, name               a tab was named; an empty name goes back to the terminal title
+//   'O' window, tab...          the tabs of a window were reordered
+//   'C' tab                     a tab was closed while its window stayed open
+//   'H' tab, length, data       lines that scrolled off a tab, compressed with zlib to data from length bytes
+// Numbers are 32-bit little-endian, strings NUL-terminated. Replaying the log gives the windows as they were when
+// the application exited; it is rewritten with just that state whenever it has grown well beyond it.
+#define SESSION_MAGIC "ILTSESS1"
+
+// Growth of the log beyond twice its size after the last rewrite at which it is rewritten again
+#define SESSION_COMPACT_SLACK (16 * 1024 * 1024)
+
+// Most history text kept per tab when the log is rewritten
+#define SESSION_HISTORY_LIMIT (8 * 1024 * 1024)
+
+// Whether windows and tabs are recorded (--session), and whether their scrollback is too (--session-scrollback)
+static gboolean session_enabled = FALSE;
+static gboolean session_history_enabled = FALSE;
+
+// Path of the log, the descriptor it is appended through or -1, and how much has been written to it so far
+static gchar *session_path = NULL;
+static gint session_fd = -1;
+static goffset session_size = 0;
+
+// Size of the log right after it was last rewritten
+static goffset session_compacted_size = 0;
+
+// Records not written yet, and the idle source writing them in one go
+static GByteArray *session_buffer = NULL;
+static guint session_flush_source = 0;
+
+static gboolean compact_session();
+static gchar* get_terminal_cwd(TerminalData *data);
+
+static void flush_session() {
+    if (session_flush_source) {
+        g_source_remove(session_flush_source);
+        session_flush_source = 0;
+    }
 
-    // Connect the key-press-event signal of the VteTerminal widget to the corresponding handler
-    connect_key_press_event_signal(widget, window);
+    for (guint written = 0; session_fd >= 0 && written < session_buffer->len; ) {
+        gssize count = write(session_fd, session_buffer->data + written, session_buffer->len - written);
 
-    // Connect the window-title-changed signal of the VteTerminal widget to the corresponding handler
-    connect_window_title_changed_signal(widget, window);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            // Stop recording rather than leave a log with holes
+            g_warning("Unable to write the session to %s: %s", session_path, g_strerror(errno));
+            close(session_fd);
+            session_fd = -1;
+            break;
+        }
 
-    // Connect the button-press-event signal of the VteTerminal widget to the corresponding handler
-    connect_button_press_event_signal(widget);
+        written += count;
+        session_size += count;
+    }
 
-    // Connect the delete-event signal of the window widget to the corresponding handler
-    connect_delete_event_signal(window);
+    g_byte_array_set_size(session_buffer, 0);
 }
 
-static void spawn_vte_terminal(GApplicationCommandLine *cli, GtkWidget *window, GtkWidget *widget) {
-    // Get the options dictionary from the command line
-    GVariantDict *options = g_application_command_line_get_options_dict(cli);
-    
-    // Retrieve the value of the "cmd" option from the options dictionary
-    const gchar *command = NULL;
-    g_variant_dict_lookup(options, "cmd", "&s", &command);
-    
-    // Get the environment variables for the terminal
-    gchar **environment = get_environment(cli);
-    
-    // Define the command and command line based on the presence of "cmd" option
-    gchar **cmd;
-    gchar *cmdline = NULL;
-    cmd = command ?
-        (gchar *[]){"/bin/sh", cmdline = g_strdup(command), NULL} :
-        (gchar *[]){cmdline = g_strdup(g_application_command_line_getenv(cli, "SHELL")), NULL};
-    
-    // Connect the VteTerminal signals to their corresponding handlers
-    connect_vte_signals(widget, window);
-    
-    // Set word char exceptions for the VteTerminal widget
-    vte_terminal_set_word_char_exceptions(VTE_TERMINAL(widget), "-./?%&_=+@~:");
-    
-    // Set the number of scrollback lines for the VteTerminal widget
-    vte_terminal_set_scrollback_lines(VTE_TERMINAL(widget), -1);
-    
-    // Enable scroll on output for the VteTerminal widget
-    vte_terminal_set_scroll_on_output(VTE_TERMINAL(widget), TRUE);
-    
-    // Enable scroll on keystroke for the VteTerminal widget
-    vte_terminal_set_scroll_on_keystroke(VTE_TERMINAL(widget), TRUE);
-    
-    // Enable mouse autohide for the VteTerminal widget
-    vte_terminal_set_mouse_autohide(VTE_TERMINAL(widget), TRUE);
-    
-    // Set bold text to be displayed as bright for the VteTerminal widget
-    vte_terminal_set_bold_is_bright(VTE_TERMINAL(widget), TRUE);
-    
-    // Enable audible bell for the VteTerminal widget
-    vte_terminal_set_audible_bell(VTE_TERMINAL(widget), TRUE);
-    
-    // Enable cursor blink mode for the VteTerminal widget
-    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(widget), TRUE);
-    
-    // Spawn the VteTerminal asynchronously
-    vte_terminal_spawn_async(VTE_TERMINAL(widget),
-        VTE_PTY_DEFAULT,
-        g_application_command_line_get_cwd(cli), 
-        cmd,
-        environment,    
-        0,      
-        NULL,
-        NULL,
-        NULL,   
-        -1,     
-        NULL,       
-        child_ready,    
-        window);        
-    
-    // Free the environment and cmdline strings
-    g_strfreev(environment);
-    g_free(cmdline);
-}
+static gboolean flush_session_idle(gpointer user_data) {
+    session_flush_source = 0;
+    flush_session();
 
-void on_new_window_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_new_window_activate\n");
-}
+    // Rewrite the log once it is mostly history of closed tabs and superseded records
+    if (session_size > 2 * session_compacted_size + SESSION_COMPACT_SLACK) {
+        compact_session();
+    }
 
-void on_new_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_new_tab_activate\n");
+    return G_SOURCE_REMOVE;
 }
 
-void on_close_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_close_activate\n");
+static gboolean is_session_recording() {
+    return session_fd >= 0;
 }
 
-void on_close_window_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    // This function is a callback for the "Close Window" menu item.
-    // It is triggered when the menu item is activated.
+static guint begin_session_record(gchar type) {
+    // The length is filled in by end_session_record
+    guint start = session_buffer->len;
+    guint8 header[5] = { type };
 
-    // Exit the application with a status code of 0, indicating successful termination.
-    exit(0);
+    g_byte_array_append(session_buffer, header, sizeof(header));
+    return start;
 }
 
-static GtkWidget* create_file_menu() {
-    GtkWidget *file_menu = gtk_menu_new();
-    char label[50];
-    
-    g_snprintf(label, sizeof(label), "%-20s %20s", "New Window", "Shift+Ctrl+N");
-    GtkWidget *new_window = gtk_menu_item_new_with_label(label);
-    g_signal_connect(new_window, "activate", G_CALLBACK(on_new_window_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), new_window);
-    
-    g_snprintf(label, sizeof(label), "%-20s %27s", "New Tab", "Shift+Ctrl+T");
-    GtkWidget *new_tab = gtk_menu_item_new_with_label(label);
-    g_signal_connect(new_tab, "activate", G_CALLBACK(on_new_tab_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), new_tab);
-    
-    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), gtk_separator_menu_item_new());
-    
-    g_snprintf(label, sizeof(label), "%-20s %27s", "Close Tab", "Shift+Ctrl+W");
-    GtkWidget *close_tab = gtk_menu_item_new_with_label(label);
-    g_signal_connect(close_tab, "activate", G_CALLBACK(on_close_tab_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), close_tab);
-    
-    g_snprintf(label, sizeof(label), "%-20s %20s", "Close Window", "Shift+Ctrl+Q");
-    GtkWidget *close_window = gtk_menu_item_new_with_label(label);
-    g_signal_connect(close_window, "activate", G_CALLBACK(on_close_window_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), close_window);
+static void put_session_u32(guint32 value) {
+    value = GUINT32_TO_LE(value);
+    g_byte_array_append(session_buffer, (const guint8 *) &value, sizeof(value));
+}
 
-    return file_menu;
+static void put_session_string(const gchar *value) {
+    g_byte_array_append(session_buffer, (const guint8 *) (value ? value : ""), strlen(value ? value : "") + 1);
 }
 
-static void on_copy_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_copy_activate\n");
+static void end_session_record(guint start) {
+    guint32 length = GUINT32_TO_LE(session_buffer->len - start - 5);
+    memcpy(session_buffer->data + start + 1, &length, sizeof(length));
+
+    // Records of one burst of changes are written together
+    if (!session_flush_source) {
+        session_flush_source = g_idle_add(flush_session_idle, NULL);
+    }
 }
 
-static void on_paste_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_paste_activate\n");
+static void record_session_window(WindowData *window_data) {
+    if (!is_session_recording()) {
+        return;
+    }
+
+    gtk_window_get_size(GTK_WINDOW(window_data->window), &window_data->session_width, &window_data->session_height);
+
+    guint start = begin_session_record('W');
+    put_session_u32(window_data->session_id);
+    put_session_u32(window_data->session_width);
+    put_session_u32(window_data->session_height);
+    end_session_record(start);
 }
 
-static void on_clear_scrollback_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_clear_scrollback_activate\n");
+static void record_session_tab(TerminalData *data) {
+    if (!is_session_recording() || !data->window || data->tab) {
+        return;
+    }
+
+    gchar *cwd = get_terminal_cwd(data);
+
+    guint start = begin_session_record('T');
+    put_session_u32(data->id);
+    put_session_u32(get_window_data(data->window)->session_id);
+    put_session_string(cwd);
+    for (gchar **argument = data->argv; *argument; ++argument) {
+        put_session_string(*argument);
+    }
+    end_session_record(start);
+
+    g_free(cwd);
 }
 
-static void on_zoom_in_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_zoom_in_activate\n");
+static void record_session_tab_name(TerminalData *data) {
+    if (!is_session_recording() || !data->window) {
+        return;
+    }
+
+    guint start = begin_session_record('N');
+    put_session_u32(data->id);
+    put_session_string(data->custom_title);
+    end_session_record(start);
 }
 
-static void on_zoom_out_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_zoom_out_activate\n");
+static void record_session_tab_order(WindowData *window_data) {
+    if (!is_session_recording()) {
+        return;
+    }
+
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+
+    guint start = begin_session_record('O');
+    put_session_u32(window_data->session_id);
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+        TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+        put_session_u32(data->id);
+    }
+    end_session_record(start);
 }
 
-static void on_zoom_reset_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_zoom_reset_activate\n");
+static void record_session_closed(gchar type, guint id) {
+    if (!is_session_recording()) {
+        return;
+    }
+
+    guint start = begin_session_record(type);
+    put_session_u32(id);
+    end_session_record(start);
 }
 
-static void on_preferences_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_preferences_activate\n");
+static gboolean is_recording_session_history(TerminalData *data) {
+    return session_history_enabled && is_session_recording() && data->window && !data->tab;
 }
 
-static GtkWidget* create_edit_menu() {
-    GtkWidget *edit_menu = gtk_menu_new();
-    char label[50];
-    
-    g_snprintf(label, sizeof(label), "%-20s %22s", "Copy", "Shift+Ctrl+C");
-    GtkWidget *copy_item = gtk_menu_item_new_with_label(label);
-    g_signal_connect(copy_item, "activate", G_CALLBACK(on_copy_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), copy_item);
+static void record_session_history(TerminalData *data, const gchar *text, gsize length) {
+    uLongf compressed_length = compressBound(length);
+    guint start = begin_session_record('H');
 
-    g_snprintf(label, sizeof(label), "%-20s %21s", "Paste", "Shift+Ctrl+V");
-    GtkWidget *paste_item = gtk_menu_item_new_with_label(label);
-    g_signal_connect(paste_item, "activate", G_CALLBACK(on_paste_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), paste_item);
+    put_session_u32(data->id);
+    put_session_u32(length);
 
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+    // Compress straight into the record; lines leave the screen in bursts, so favour speed over ratio
+    guint payload = session_buffer->len;
+    g_byte_array_set_size(session_buffer, payload + compressed_length);
+    if (compress2(session_buffer->data + payload, &compressed_length, (const Bytef *) text, length, Z_BEST_SPEED) != Z_OK) {
+        g_byte_array_set_size(session_buffer, start);
+        return;
+    }
+    g_byte_array_set_size(session_buffer, payload + compressed_length);
 
-    GtkWidget *clear_scrollback = gtk_menu_item_new_with_label("Clear Scrollback");
-    g_signal_connect(clear_scrollback, "activate", G_CALLBACK(on_clear_scrollback_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), clear_scrollback);
+    // Remember where the chunk lands in the log
+    SessionChunk chunk = { session_size + start, session_buffer->len - start, length };
+    if (!data->session_chunks) {
+        data->session_chunks = g_array_new(FALSE, FALSE, sizeof(SessionChunk));
+    }
+    g_array_append_val(data->session_chunks, chunk);
 
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+    end_session_record(start);
+}
 
-    g_snprintf(label, sizeof(label), "%-20s %18s", "Zoom In", "Shift+Ctrl++");
-    GtkWidget *zoom_in = gtk_menu_item_new_with_label(label);
-    g_signal_connect(zoom_in, "activate", G_CALLBACK(on_zoom_in_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_in);
+// Reading the child's output, defined together with the PTY input below
+static void drain_pty_output(PtyReader *reader);
 
-    g_snprintf(label, sizeof(label), "%-20s %15s", "Zoom Out", "Shift+Ctrl+_");
-    GtkWidget *zoom_out = gtk_menu_item_new_with_label(label);
-    g_signal_connect(zoom_out, "activate", G_CALLBACK(on_zoom_out_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_out);
+static void child_process_exited(GPid pid, gint status, gpointer user_data) {
+    TerminalData *data = user_data;
 
-    g_snprintf(label, sizeof(label), "%-20s %13s", "Zoom Reset", "Shift+Ctrl+)");
-    GtkWidget *zoom_reset = gtk_menu_item_new_with_label(label);
-    g_signal_connect(zoom_reset, "activate", G_CALLBACK(on_zoom_reset_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_reset);
+    // Show what the child wrote last before reporting its exit, like VTE does for the children it watches
+    data->child_watch = 0;
+    g_spawn_close_pid(pid);
+    drain_pty_output(&data->output);
+    g_signal_emit_by_name(data->terminal, "child-exited", status);
+}
 
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+static void child_ready(VteTerminal* terminal, GPid pid, GError* error, gpointer user_data) {
+    // Check if the terminal widget is valid
+    if (!terminal) {
+        return;
+    }
 
-    GtkWidget *preferences = gtk_menu_item_new_with_label("Preferences");
-    g_signal_connect(preferences, "activate", G_CALLBACK(on_preferences_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), preferences);
-    
-    return edit_menu;
+    // Check if the child process identifier is 0, indicating an error
+    if (pid == 0) {
+        // Close the tab, and the window if it was the last tab, passing the error code
+        close_terminal_tab(user_data, error->code);
+        return;
+    }
+
+    // Remember the child for the stats interface, and report its exit through "child-exited"; VTE would only
+    // report it once its own PTY, the relay, is closed
+    TerminalData *data = user_data;
+    data->child_pid = pid;
+    data->child_watch = g_child_watch_add(pid, child_process_exited, data);
 }
 
-void on_name_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_name_tab_activate\n");
+static void connect_child_exited_signal(GtkWidget* widget, TerminalData* data) {
+    // Connect the "child-exited" signal of the widget to the "child_exited" callback function
+    g_signal_connect(widget, "child-exited", G_CALLBACK(child_exited), data);
 }
 
-void on_previous_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_previous_tab_activate\n");
+static void connect_key_press_event_signal(GtkWidget* widget, TerminalData* data) {
+    // Connect the "key-press-event" signal of the widget to the "key_press_event" callback function
+    g_signal_connect(widget, "key-press-event", G_CALLBACK(key_press_event), data);
 }
 
-void on_next_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_next_tab_activate\n");
+static void connect_window_title_changed_signal(GtkWidget* widget, TerminalData* data) {
+    // Connect the "window-title-changed" signal of the widget to the "window_title_changed" callback function
+    g_signal_connect(widget, "window-title-changed", G_CALLBACK(window_title_changed), data);
 }
 
-void on_move_tab_left_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_move_tab_left_activate\n");
+static void connect_button_press_event_signal(GtkWidget* widget, TerminalData* data) {
+    // Connect the "button_press_event" signal of the widget to the "button_press_event" callback function
+    g_signal_connect(widget, "button_press_event", G_CALLBACK(button_press_event), data);
 }
 
-void on_move_tab_right_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    g_print("on_move_tab_right_activate\n");
+static void connect_delete_event_signal(GtkWidget* window) {
+    // Connect the "delete-event" signal of the window widget to the "confirm_exit" callback function
+    g_signal_connect(window, "delete-event", G_CALLBACK(confirm_exit), NULL);
 }
 
-static GtkWidget* create_tabs_menu() {
-    GtkWidget *tabs_menu = gtk_menu_new();
-    char label[50];
-    
-    g_snprintf(label, sizeof(label), "%-20s %18s", "Name Tab", "Shift+Ctrl+I");
-    GtkWidget *name_tab = gtk_menu_item_new_with_label(label);
-    g_signal_connect(name_tab, "activate", G_CALLBACK(on_name_tab_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), name_tab);
+static void latency_output_changed(VteTerminal *terminal, gpointer user_data);
 
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+static void trace_terminal_latency(TerminalData *data) {
+    g_signal_connect(data->terminal, "contents-changed", G_CALLBACK(latency_output_changed), data);
+}
 
-    g_snprintf(label, sizeof(label), "%-20s %16s", "Previous Tab", "Ctrl+Page Up");
-    GtkWidget *previous_tab = gtk_menu_item_new_with_label(label);
-    g_signal_connect(previous_tab, "activate", G_CALLBACK(on_previous_tab_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), previous_tab);
+static void latency_output_changed(VteTerminal *terminal, gpointer user_data) {
+    TerminalData *data = user_data;
+    WindowData *window_data = data->window ? get_window_data(data->window) : NULL;
 
-    g_snprintf(label, sizeof(label), "%-20s %23s", "Next Tab", "Ctrl+Page Down");
-    GtkWidget *next_tab = gtk_menu_item_new_with_label(label);
-    g_signal_connect(next_tab, "activate", G_CALLBACK(on_next_tab_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), next_tab);
+    // The first change of the tab that got the keystroke is taken as its echo
+    if (window_data && window_data->latency_terminal == data->id && window_data->latency_key_time && !window_data->latency_output_time) {
+        window_data->latency_output_time = g_get_monotonic_time();
+    }
+}
 
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+static gboolean pane_focused(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
+    TerminalData *data = user_data;
+    TerminalData *tab = data->tab ? data->tab : data;
+    TerminalData *active_pane = data->tab ? data : NULL;
 
-    g_snprintf(label, sizeof(label), "%-20s %21s", "Move Tab Left", "Shift+Ctrl+Page Up");
-    GtkWidget *move_tab_left = gtk_menu_item_new_with_label(label);
-    g_signal_connect(move_tab_left, "activate", G_CALLBACK(on_move_tab_left_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), move_tab_left);
+    // Actions and the title follow the pane last focused
+    if (tab->active_pane != active_pane) {
+        tab->active_pane = active_pane;
+        update_tab_title(tab);
+    }
 
-    g_snprintf(label, sizeof(label), "%-20s %21s", "Move Tab Right", "Shift+Ctrl+Page Down");
-    GtkWidget *move_tab_right = gtk_menu_item_new_with_label(label);
-    g_signal_connect(move_tab_right, "activate", G_CALLBACK(on_move_tab_right_activate), NULL);
-    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), move_tab_right);
-    
-    return tabs_menu;
+    return FALSE;
 }
 
-// Set the properties of a window, such as title, modal behavior, and resizable state
-void set_window_properties(GtkWidget *window, const gchar *title, GtkWindow *parent, gboolean modal, gboolean resizable) {
-    // Set the window title
-    gtk_window_set_title(GTK_WINDOW(window), title); 
-    // Set modal behavior (whether it blocks input to other windows)
-    gtk_window_set_modal(GTK_WINDOW(window), modal); 
-    // Set the parent window for the transient behavior
-    gtk_window_set_transient_for(GTK_WINDOW(window), GTK_WINDOW(parent)); 
-    // Set the resizable state of the window
-    gtk_window_set_resizable(GTK_WINDOW(window), resizable); 
-}
+static void connect_vte_signals(GtkWidget* widget, TerminalData* data) {
+    // Connect the child-exited signal of the VteTerminal widget to the corresponding handler
+    connect_child_exited_signal(widget, data);
 
-// Create a header bar widget with the specified title
-GtkWidget* create_header_bar(const gchar *title) {
-    // Create a new header bar widget
-    GtkWidget *header = gtk_header_bar_new(); 
-    // Set the title of the header bar
-    gtk_header_bar_set_title(GTK_HEADER_BAR(header), title); 
-    // Show the close button on the header bar
-    gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(header), TRUE); 
-    // Return the created header bar widget
-    return header; 
-}
+    // Connect the key-press-event signal of the VteTerminal widget to the corresponding handler
+    connect_key_press_event_signal(widget, data);
 
-// Create an image widget with the specified image file
-GtkWidget* create_image(const gchar *filename) {
-    // Create a new image widget from the specified file  
-    GtkWidget *image = gtk_image_new_from_file(filename); 
-    // Return the created image widget
-    return image; 
-}
+    // Connect the window-title-changed signal of the VteTerminal widget to the corresponding handler
+    connect_window_title_changed_signal(widget, data);
 
-// Create a label widget with the specified markup text
-GtkWidget* create_label_with_markup(const gchar *markup) {
-    // Create a new label widget
-    GtkWidget *label = gtk_label_new(NULL); 
-    // Set the markup text for the label
-    gtk_label_set_markup(GTK_LABEL(label), markup); 
-    // Return the created label widget
-    return label; 
+    // Connect the button-press-event signal of the VteTerminal widget to the corresponding handler
+    connect_button_press_event_signal(widget, data);
+
+    // Record the directory the shell reports in the session
+    g_signal_connect_swapped(widget, "current-directory-uri-changed", G_CALLBACK(record_session_tab), data);
+
+    // Track which pane of a split tab is being used
+    g_signal_connect(widget, "focus-in-event", G_CALLBACK(pane_focused), data);
+
+    // Note when the terminal answers a traced keystroke
+    if (latency_trace_enabled) {
+        trace_terminal_latency(data);
+    }
 }
 
-// Create a separator widget with the specified orientation
-GtkWidget* create_separator(GtkOrientation orientation) {
-    // Create a new separator widget with the specified orientation
-    GtkWidget *separator = gtk_separator_new(orientation); 
-    // Return the created separator widget
-    return separator; 
+static TerminalData* get_terminal_data(VteTerminal *terminal) {
+    // Look up the per-terminal state stored on the widget
+    return g_object_get_data(G_OBJECT(terminal), "terminal-data");
 }
 
-// Create a link button widget with the specified URI and label text
-GtkWidget* create_link_button(const gchar *uri, const gchar *label) {
+static glong get_scrollback_budget(TerminalData *data) {
+    // Share the process-wide cap evenly between all live terminals
+    guint count = MAX(g_list_length(terminals), 1);
+    glong columns = MAX(vte_terminal_get_column_count(data->terminal), 1);
+    glong lines = scrollback_memory_cap / count / (columns * SCROLLBACK_BYTES_PER_CELL);
+
+    // Never trim a terminal below a small usable history
+    lines = MAX(lines, SCROLLBACK_MIN_LINES);
+
+    // A line count given to the invocation that opened the terminal wins when below the budget
+    const ScrollbackPolicy *policy = &data->environment->scrollback;
+    if (policy->lines >= 0 && policy->lines < lines) {
+        lines = policy->lines;
+    }
+
+    // So does a trim under memory pressure
+    if (data->scrollback_limit && data->scrollback_limit < lines) {
+        lines = data->scrollback_limit;
+    }
+
+    return lines;
+}
+
+static gboolean get_unspilled_rows(TerminalData *data, glong *start, glong *end) {
+    // Nothing to do unless this terminal spills to disk or records its history in the session
+    if (!data->spill_file && !is_recording_session_history(data)) {
+        return FALSE;
+    }
+
+    // The vertical adjustment spans every row VTE still holds, in absolute row numbers
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(data->terminal));
+    glong lower = (glong) gtk_adjustment_get_lower(adjustment);
+    glong upper = (glong) gtk_adjustment_get_upper(adjustment);
+
+    // Rows above the visible screen are final and can be written out
+    *end = upper - vte_terminal_get_row_count(data->terminal);
+
+    // After a reset the row numbers start over
+    if (data->spilled_row > upper) {
+        data->spilled_row = lower;
+    }
+
+    // Rows that were dropped before we got to them are lost, continue from the oldest one still held
+    *start = MAX(data->spilled_row, lower);
+
+    return *start < *end;
+}
+
+static gboolean spill_scrollback_rows(TerminalData *data) {
+    glong start, end;
+
+    if (!get_unspilled_rows(data, &start, &end)) {
+        return FALSE;
+    }
+
+    // Fetch the next chunk of finished rows as plain text and append it to the compressed spill file and session log
+    glong chunk_end = MIN(end, start + SPILL_CHUNK_ROWS);
+    gsize length = 0;
+    gchar *text = vte_terminal_get_text_range_format(data->terminal, VTE_FORMAT_TEXT, start, 0, chunk_end - 1,
+                                                     vte_terminal_get_column_count(data->terminal), &length);
+    if (text) {
+        if (data->spill_file && gzwrite(data->spill_file, text, length) > 0) {
+            if (data->spill_length == 0) {
+                data->spill_first_row = start;
+            }
+            data->spill_length += length;
+            data->spill_end_row = chunk_end;
+        }
+        if (is_recording_session_history(data)) {
+            record_session_history(data, text, length);
+        }
+        g_free(text);
+    }
+
+    // Remember where the next chunk starts, and tell whether there is one
+    data->spilled_row = chunk_end;
+    return chunk_end < end;
+}
+
+static void apply_scrollback_budget(TerminalData *data);
+
+static gboolean spill_scrollback_idle(gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // Write out one chunk of whatever scrolled off the screen since the last flush, and come back for the next
+    if (spill_scrollback_rows(data)) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Caught up: a smaller ring waiting for its oldest rows to be saved can be applied now
+    data->spill_source = 0;
+    apply_scrollback_budget(data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_scrollback_spill(TerminalData *data) {
+    // Coalesce bursts of output into one flush, run a chunk at a time when the main loop is idle
+    if ((data->spill_file || is_recording_session_history(data)) && !data->spill_source) {
+        data->spill_source = g_idle_add(spill_scrollback_idle, data);
+    }
+}
+
+static void scrollback_contents_changed(VteTerminal *terminal, gpointer user_data) {
+    schedule_scrollback_spill(user_data);
+}
+
+static void apply_scrollback_budget(TerminalData *data) {
+    glong lines = get_scrollback_budget(data);
+    glong start, end;
+
+    if (lines == data->scrollback_lines) {
+        return;
+    }
+
+    // A shrinking ring drops its oldest rows; save them first and apply the new size once they are written
+    if (lines < data->scrollback_lines && get_unspilled_rows(data, &start, &end)) {
+        schedule_scrollback_spill(data);
+        return;
+    }
+
+    vte_terminal_set_scrollback_lines(data->terminal, lines);
+    data->scrollback_lines = lines;
+}
+
+static void rebalance_scrollback() {
+    // Apply the current budget to every live terminal
+    for (GList *item = terminals; item; item = item->next) {
+        apply_scrollback_budget(item->data);
+    }
+}
+
+static void open_spill_file(TerminalData *data) {
+    // Spill files live in the user's cache directory, which unlike /tmp is rarely backed by RAM
+    gchar *directory = g_build_filename(g_get_user_cache_dir(), "illumiterm", NULL);
+    g_mkdir_with_parents(directory, 0700);
+
+    // Create a private, uniquely named file for this terminal
+    data->spill_path = g_build_filename(directory, "scrollback-XXXXXX.gz", NULL);
+    gint fd = g_mkstemp_full(data->spill_path, O_WRONLY, 0600);
+    g_free(directory);
+
+    if (fd < 0) {
+        g_warning("Unable to create scrollback spill file %s", data->spill_path);
+        g_clear_pointer(&data->spill_path, g_free);
+        return;
+    }
+
+    // Favour speed over ratio, scrollback text compresses well anyway
+    data->spill_file = gzdopen(fd, "wb1");
+}
+
+static void release_scrollback(GtkWidget *widget, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // Stop tracking the terminal and hand its share of the cap to the others
+    terminals = g_list_remove(terminals, data);
+    data->terminal = NULL;
+    rebalance_scrollback();
+
+    // Cancel a pending flush
+    if (data->spill_source) {
+        g_source_remove(data->spill_source);
+        data->spill_source = 0;
+    }
+
+    // The spill file only backs this terminal's history, remove it together with the terminal
+    if (data->spill_file) {
+        gzclose(data->spill_file);
+        data->spill_file = NULL;
+    }
+    if (data->spill_path) {
+        g_unlink(data->spill_path);
+        g_clear_pointer(&data->spill_path, g_free);
+    }
+}
+
+static void setup_scrollback(TerminalData *data) {
+    // Nothing has been applied to the new terminal yet
+    data->scrollback_lines = -1;
+
+    // Open a spill file if the invocation that opened the terminal asked for one
+    if (data->environment->scrollback.spill) {
+        open_spill_file(data);
+    }
+
+    // Flush rows to the spill file as they scroll off the screen
+    g_signal_connect(data->terminal, "contents-changed", G_CALLBACK(scrollback_contents_changed), data);
+
+    // Give the scrollback back when the terminal goes away
+    g_signal_connect(data->terminal, "destroy", G_CALLBACK(release_scrollback), data);
+
+    // Track the terminal and share out the memory cap again
+    terminals = g_list_append(terminals, data);
+    rebalance_scrollback();
+}
+
+static gsize get_pending_pty_input(PtyWriter *writer);
+static void write_pty_input(PtyWriter *writer, const void *bytes, gsize length);
+static gboolean pty_output_readable(gint fd, GIOCondition condition, gpointer user_data);
+
+static void watch_pty_output(PtyReader *reader) {
+    // Wait for more output, unless there is no more or the relay is still full
+    if (!reader->source && !reader->eof && get_pending_pty_input(reader->relay) < PTY_BACKLOG_LIMIT) {
+        reader->source = g_unix_fd_add_full(reader->priority, reader->fd, G_IO_IN, pty_output_readable, reader, NULL);
+    }
+}
+
+static gboolean read_pty_output(PtyReader *reader) {
+    // Only ever used from the main loop
+    static guint8 chunk[PTY_CHUNK_SIZE];
+    gssize count = read(reader->fd, chunk, sizeof chunk);
+
+    if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return FALSE;
+    }
+
+    // A PTY master reports EIO rather than end of file once every slave is closed
+    if (count <= 0) {
+        reader->eof = TRUE;
+        return FALSE;
+    }
+
+    reader->bytes += count;
+    reader->received(reader->user_data, chunk, count);
+    write_pty_input(reader->relay, chunk, count);
+
+    return TRUE;
+}
+
+static gboolean pty_output_readable(gint fd, GIOCondition condition, gpointer user_data) {
+    PtyReader *reader = user_data;
+
+    read_pty_output(reader);
+    if (!reader->eof && get_pending_pty_input(reader->relay) < PTY_BACKLOG_LIMIT) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Stop at the end, or until VTE took what waits for the relay (relay_output_drained)
+    reader->source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+static void relay_output_drained(gpointer user_data) {
+    PtyReader *reader = user_data;
+
+    // VTE read everything passed on so far, read on
+    if (reader->fd >= 0) {
+        watch_pty_output(reader);
+    }
+}
+
+static void drain_pty_output(PtyReader *reader) {
+    // Take in what is left once the child exited, without waiting on children it left behind that keep writing
+    for (gsize count = 0; reader->fd >= 0 && count < PTY_BACKLOG_LIMIT && read_pty_output(reader); count += PTY_CHUNK_SIZE) {
+    }
+}
+
+static void start_pty_output(PtyReader *reader, gint fd, gint priority, PtyWriter *relay, gpointer user_data) {
+    reader->fd = fd;
+    reader->priority = priority;
+    reader->relay = relay;
+    reader->user_data = user_data;
+    relay->drained = relay_output_drained;
+    watch_pty_output(reader);
+}
+
+static void set_pty_output_priority(PtyReader *reader, gint priority) {
+    reader->priority = priority;
+
+    // Move the pending source as well; new ones are created at the new priority
+    if (reader->source) {
+        g_source_set_priority(g_main_context_find_source_by_id(NULL, reader->source), priority);
+    }
+}
+
+static void stop_pty_output(PtyReader *reader) {
+    if (reader->source) {
+        g_source_remove(reader->source);
+        reader->source = 0;
+    }
+    reader->fd = -1;
+}
+
+static void flush_pty_input(PtyWriter *writer);
+
+static gboolean pty_input_writable(gint fd, GIOCondition condition, gpointer user_data) {
+    PtyWriter *writer = user_data;
+
+    writer->source = 0;
+    flush_pty_input(writer);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gsize get_pending_pty_input(PtyWriter *writer) {
+    return writer->buffer ? writer->buffer->len - writer->offset : 0;
+}
+
+static guint8* extend_pty_input(PtyWriter *writer, gsize length) {
+    // Move what is still queued to the front only once most of the buffer has been written, so that
+    // a writer that falls behind does not move the whole queue for every partial write
+    if (writer->offset >= PTY_CHUNK_SIZE && writer->offset >= writer->buffer->len / 2) {
+        g_byte_array_remove_range(writer->buffer, 0, writer->offset);
+        writer->offset = 0;
+    }
+
+    guint start = writer->buffer->len;
+    g_byte_array_set_size(writer->buffer, start + length);
+
+    return writer->buffer->data + start;
+}
+
+static void queue_pty_input(PtyWriter *writer, const void *bytes, gsize length) {
+    // Queue the bytes after anything already waiting
+    if (writer->buffer && length) {
+        memcpy(extend_pty_input(writer, length), bytes, length);
+    }
+}
+
+static void flush_pty_input(PtyWriter *writer) {
+    if (!writer->buffer) {
+        return;
+    }
+
+    // Write as much as the child accepts without blocking
+    while (writer->offset < writer->buffer->len) {
+        gssize count = write(writer->fd, writer->buffer->data + writer->offset, writer->buffer->len - writer->offset);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && errno != EAGAIN) {
+            // The child is gone, so is everything still waiting for it
+            break;
+        }
+        if (count <= 0) {
+            // Continue once it has room again
+            if (!writer->source) {
+                writer->source = g_unix_fd_add_full(G_PRIORITY_HIGH, writer->fd, G_IO_OUT, pty_input_writable, writer, NULL);
+            }
+            return;
+        }
+
+        writer->offset += count;
+    }
+
+    // Everything has been written, start over at the front of the buffer
+    g_byte_array_set_size(writer->buffer, 0);
+    writer->offset = 0;
+
+    // Let another writer top the queue up
+    if (writer->drained) {
+        writer->drained(writer->user_data);
+    }
+}
+
+static void write_pty_input(PtyWriter *writer, const void *bytes, gsize length) {
+    // Queue the bytes after anything already waiting and pass on what fits
+    queue_pty_input(writer, bytes, length);
+    flush_pty_input(writer);
+}
+
+static void start_pty_input(PtyWriter *writer, gint fd, gpointer user_data) {
+    writer->fd = fd;
+    writer->user_data = user_data;
+    writer->offset = 0;
+    writer->buffer = g_byte_array_sized_new(PTY_CHUNK_SIZE);
+}
+
+static void stop_pty_input(PtyWriter *writer) {
+    if (writer->source) {
+        g_source_remove(writer->source);
+        writer->source = 0;
+    }
+    g_clear_pointer(&writer->buffer, g_byte_array_unref);
+}
+
+// Reporting, defined right below
+static void finish_startup_profile();
+
+static gboolean startup_profile_timed_out(gpointer user_data) {
+    // The window never painted, report what it got through
+    startup_profile->timeout = 0;
+    g_application_command_line_printerr(startup_profile->cli, "profile-startup: no frame after %d s\n", STARTUP_PROFILE_TIMEOUT);
+    finish_startup_profile();
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean start_startup_profile(GApplicationCommandLine *cli) {
+    // Another window is still being timed
+    if (startup_profile) {
+        g_application_command_line_printerr(cli, "illumiterm: another window is still being timed, --profile-startup is ignored\n");
+        return FALSE;
+    }
+
+    startup_profile = g_new0(StartupProfile, 1);
+    startup_profile->cli = g_object_ref(cli);
+    startup_profile->timeout = g_timeout_add_seconds(STARTUP_PROFILE_TIMEOUT, startup_profile_timed_out, NULL);
+
+    // The primary instance's own window counts from the start of the process, including the toolkit;
+    // a window opened for another invocation finds the toolkit up and counts from its command line
+    if (!g_application_command_line_get_is_remote(cli) && gtk_init_time) {
+        startup_profile->origin = process_start_time;
+        startup_profile->start[STARTUP_GTK_INIT] = process_start_time;
+        startup_profile->end[STARTUP_GTK_INIT] = gtk_init_time;
+    } else {
+        startup_profile->origin = g_get_monotonic_time();
+    }
+
+    return TRUE;
+}
+
+static void finish_startup_profile() {
+    StartupProfile *profile = startup_profile;
+
+    // Report the phases in the order they run, and the time from the start until the first frame
+    for (guint i = 0; i < STARTUP_PHASES; ++i) {
+        if (profile->start[i] && profile->end[i]) {
+            g_application_command_line_printerr(profile->cli, "profile-startup: %-12s %8.3f ms\n", startup_phase_names[i],
+                                                (profile->end[i] - profile->start[i]) / 1000.0);
+        } else if (profile->ready[i]) {
+            g_application_command_line_printerr(profile->cli, "profile-startup: %-12s  done before\n", startup_phase_names[i]);
+        } else {
+            g_application_command_line_printerr(profile->cli, "profile-startup: %-12s  not timed\n", startup_phase_names[i]);
+        }
+    }
+    if (profile->end[STARTUP_FIRST_PAINT]) {
+        g_application_command_line_printerr(profile->cli, "profile-startup: %-12s %8.3f ms\n", "total",
+                                            (profile->end[STARTUP_FIRST_PAINT] - profile->origin) / 1000.0);
+    }
+
+    if (profile->timeout) {
+        g_source_remove(profile->timeout);
+    }
+    g_object_unref(profile->cli);
+    g_free(profile);
+    startup_profile = NULL;
+}
+
+static void startup_window_destroyed(GtkWidget *widget, gpointer user_data) {
+    // A window closed before its first frame reports what it got through, and lets go of the command line
+    if (startup_profile && startup_profile->window == widget) {
+        finish_startup_profile();
+    }
+}
+
+static void claim_startup_terminal(TerminalData *data) {
+    // With --profile-startup, the first terminal started or shown for the window is the one timed
+    if (!startup_profile || startup_profile->tab) {
+        return;
+    }
+    startup_profile->tab = data;
+    startup_profile->window = data->window;
+    g_signal_connect(data->window, "destroy", G_CALLBACK(startup_window_destroyed), NULL);
+
+    // The windows of a restored session are built on the way, waiting for the first frame starts here
+    gint64 now = g_get_monotonic_time();
+    if (!startup_profile->end[STARTUP_WIDGET_BUILD]) {
+        startup_profile->end[STARTUP_WIDGET_BUILD] = now;
+    }
+    if (!startup_profile->start[STARTUP_FIRST_PAINT]) {
+        startup_profile->start[STARTUP_FIRST_PAINT] = now;
+    }
+
+    // A pooled terminal comes with its widget and fonts and maybe its shell, a reattached one with its child
+    startup_profile->ready[STARTUP_FONT_SETUP] = data->terminal != NULL;
+    startup_profile->ready[STARTUP_SPAWN] = data->child_pid != 0 || data->spawn_cancellable != NULL;
+}
+
+static void begin_startup_phase(TerminalData *data, StartupPhase phase) {
+    // Only the first terminal of the window being timed takes part, in what it has not done yet
+    if (startup_profile && startup_profile->tab == data && !startup_profile->ready[phase] && !startup_profile->start[phase]) {
+        startup_profile->start[phase] = g_get_monotonic_time();
+    }
+}
+
+static void end_startup_phase(TerminalData *data, StartupPhase phase) {
+    // Later resizes and frames of the terminal are not part of the startup
+    if (!startup_profile || startup_profile->tab != data || !startup_profile->start[phase] || startup_profile->end[phase]) {
+        return;
+    }
+    startup_profile->end[phase] = g_get_monotonic_time();
+
+    // Report once the terminal has its grid, its child and its first frame
+    if ((startup_profile->end[STARTUP_FONT_SETUP] || startup_profile->ready[STARTUP_FONT_SETUP]) &&
+        (startup_profile->end[STARTUP_SPAWN] || startup_profile->ready[STARTUP_SPAWN]) && startup_profile->end[STARTUP_FIRST_PAINT]) {
+        finish_startup_profile();
+    }
+}
+
+static void forget_startup_terminal(TerminalData *data) {
+    // A terminal closed before it was fully up reports what it got through
+    if (startup_profile && startup_profile->tab == data) {
+        finish_startup_profile();
+    }
+}
+
+static void resize_child_pty(TerminalData *data) {
+    glong rows = vte_terminal_get_row_count(data->terminal);
+    glong columns = vte_terminal_get_column_count(data->terminal);
+
+    // VTE has no PTY of its own to resize, pass the size on to the child's
+    if (data->pty && (rows != data->pty_rows || columns != data->pty_columns)) {
+        // The scrollback budget is counted in lines of the terminal's width
+        gboolean columns_changed = columns != data->pty_columns;
+
+        vte_pty_set_size(data->pty, rows, columns, NULL);
+        data->pty_rows = rows;
+        data->pty_columns = columns;
+
+        if (columns_changed) {
+            rebalance_scrollback();
+        }
+    }
+}
+
+static gboolean apply_pty_size(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+    resize_child_pty(user_data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void clear_pty_size_tick(gpointer user_data) {
+    // Also reached when the terminal is unrealized before the frame, a later allocation schedules again
+    ((TerminalData *) user_data)->pty_size_tick = 0;
+}
+
+static void sync_pty_size(GtkWidget *widget, GdkRectangle *allocation, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // The first allocation lays out the grid in the configured font
+    end_startup_phase(data, STARTUP_FONT_SETUP);
+
+    // Dragging a divider reallocates the panes many times between frames; the child is resized once a frame
+    if (!data->pty_size_tick) {
+        data->pty_size_tick = gtk_widget_add_tick_callback(widget, apply_pty_size, data, clear_pty_size_tick);
+    }
+}
+
+static gboolean count_terminal_frame(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    data->frames_drawn++;
+    end_startup_phase(data, STARTUP_FIRST_PAINT);
+    return FALSE;
+}
+
+static void child_spawned(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    TerminalData *data = user_data;
+    GError *error = NULL;
+    GPid pid = 0;
+
+    // The terminal may have gone away while the child was being spawned, taking the tab state with it
+    if (!vte_pty_spawn_finish(VTE_PTY(source_object), result, &pid, &error) && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free(error);
+        return;
+    }
+
+    g_clear_object(&data->spawn_cancellable);
+    end_startup_phase(data, STARTUP_SPAWN);
+    child_ready(data->terminal, pid, error, data);
+    g_clear_error(&error);
+}
+
+static void freeze_window_updates(WindowData *window_data, gboolean frozen) {
+    if (window_data->frame_cap_frozen == frozen) {
+        return;
+    }
+
+    // Invalidated areas pile up while frozen and are painted together once thawed
+    GdkWindow *window = gtk_widget_get_window(window_data->window);
+    if (frozen) {
+        gdk_window_freeze_updates(window);
+    } else {
+        gdk_window_thaw_updates(window);
+    }
+    window_data->frame_cap_frozen = frozen;
+}
+
+static gboolean release_capped_frame(gpointer user_data) {
+    // Let the next frame through; it freezes the window again once painted
+    freeze_window_updates(user_data, FALSE);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void capped_frame_painted(GdkFrameClock *clock, gpointer user_data) {
+    WindowData *window_data = get_window_data(user_data);
+
+    if (window_data->frame_cap_source) {
+        freeze_window_updates(window_data, TRUE);
+    }
+}
+
+static void update_frame_cap(WindowData *window_data) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    gboolean capped = FALSE;
+
+    // Cap the window's frame rate while a terminal that is rendered floods, in any pane
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook) && !capped; ++i) {
+        TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+        capped = data->terminal && data->flooding && !data->throttled;
+
+        for (GList *item = data->panes; item && !capped; item = item->next) {
+            TerminalData *pane = item->data;
+            capped = pane->terminal && pane->flooding && !pane->throttled;
+        }
+    }
+
+    if (capped && !window_data->frame_cap_source) {
+        window_data->frame_cap_source = g_timeout_add(FLOOD_FRAME_INTERVAL, release_capped_frame, window_data);
+        freeze_window_updates(window_data, TRUE);
+    } else if (!capped && window_data->frame_cap_source) {
+        g_source_remove(window_data->frame_cap_source);
+        window_data->frame_cap_source = 0;
+        freeze_window_updates(window_data, FALSE);
+    }
+}
+
+static gboolean sample_output_rate(gpointer user_data);
+
+static void set_terminal_flooding(TerminalData *data, gboolean flooding) {
+    data->flooding = flooding;
+
+    // Let the toolkit's own events and keyboard input overtake the flood
+    set_pty_output_priority(&data->output, flooding ? G_PRIORITY_DEFAULT_IDLE : G_PRIORITY_DEFAULT);
+
+    if (flooding) {
+        data->flood_source = g_timeout_add(FLOOD_SAMPLE_INTERVAL, sample_output_rate, data);
+    } else if (data->flood_source) {
+        g_source_remove(data->flood_source);
+        data->flood_source = 0;
+    }
+
+    if (data->window) {
+        update_frame_cap(get_window_data(data->window));
+    }
+}
+
+static void update_output_rate(TerminalData *data, gint64 now) {
+    gint64 elapsed = now - data->flood_sample_start;
+
+    // Wait until the sample is complete
+    if (elapsed < FLOOD_SAMPLE_INTERVAL * 1000) {
+        return;
+    }
+
+    gboolean fast = data->flood_sample_bytes * G_USEC_PER_SEC / elapsed >= FLOOD_RATE;
+    data->flood_samples = fast ? data->flood_samples + 1 : 0;
+    data->flood_sample_start = now;
+    data->flood_sample_bytes = 0;
+
+    if (!data->flooding && data->flood_samples >= FLOOD_SAMPLES) {
+        set_terminal_flooding(data, TRUE);
+    } else if (data->flooding && !fast) {
+        set_terminal_flooding(data, FALSE);
+    }
+}
+
+static gboolean sample_output_rate(gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // The source is removed with flood mode, which this may end
+    update_output_rate(data, g_get_monotonic_time());
+
+    return data->flooding ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+// How far track_bracketed_paste got into a sequence: ESC, ESC [, or ESC [ ? and the modes being switched
+enum {
+    PASTE_MODE_OUTSIDE,
+    PASTE_MODE_ESCAPE,
+    PASTE_MODE_CSI,
+    PASTE_MODE_PRIVATE
+};
+
+static void track_bracketed_paste(TerminalData *data, const guint8 *bytes, gsize count) {
+    const guint8 *end = bytes + count;
+    guint state = data->bracketed_paste_state;
+    guint mode = data->bracketed_paste_mode;
+    gboolean listed = data->bracketed_paste_listed;
+
+    // Follow the child switching the mode on and off with DECSET and DECRST, which may switch several modes
+    // at once, and resetting the terminal; the sequence may be split across reads
+    while (bytes < end) {
+        if (state == PASTE_MODE_OUTSIDE) {
+            bytes = memchr(bytes, '\033', end - bytes);
+            if (!bytes) {
+                break;
+            }
+            state = PASTE_MODE_ESCAPE;
+            ++bytes;
+        } else if (state == PASTE_MODE_ESCAPE) {
+            // On a mismatch the byte is looked at again, it may start the next sequence
+            if (*bytes == 'c') {
+                // RIS turns bracketed paste off with everything else
+                data->bracketed_paste = FALSE;
+                ++bytes;
+            } else if (*bytes == '[') {
+                state = PASTE_MODE_CSI;
+                ++bytes;
+                continue;
+            }
+            state = PASTE_MODE_OUTSIDE;
+        } else if (state == PASTE_MODE_CSI) {
+            if (*bytes == '?') {
+                state = PASTE_MODE_PRIVATE;
+                mode = 0;
+                listed = FALSE;
+                ++bytes;
+            } else {
+                state = PASTE_MODE_OUTSIDE;
+            }
+        } else if (g_ascii_isdigit(*bytes)) {
+            mode = MIN(mode * 10 + (*bytes - '0'), G_MAXUINT16);
+            ++bytes;
+        } else if (*bytes == ';') {
+            listed = listed || mode == BRACKETED_PASTE_MODE;
+            mode = 0;
+            ++bytes;
+        } else {
+            listed = listed || mode == BRACKETED_PASTE_MODE;
+            if (*bytes == 'h' || *bytes == 'l') {
+                if (listed) {
+                    data->bracketed_paste = *bytes == 'h';
+                }
+                ++bytes;
+            }
+            state = PASTE_MODE_OUTSIDE;
+        }
+    }
+
+    data->bracketed_paste_state = state;
+    data->bracketed_paste_mode = mode;
+    data->bracketed_paste_listed = listed;
+}
+
+// Bytes of output a log buffers for its writer, a power of two, and the amount worth waking the writer for
+#define LOG_RING_SIZE (4 * 1024 * 1024)
+#define LOG_BLOCK_SIZE (256 * 1024)
+
+// Longest time output waits in the buffer before it is written anyway, in microseconds
+#define LOG_FLUSH_INTERVAL G_USEC_PER_SEC
+
+// Output of one terminal on its way to disk: the main loop adds to a single-producer, single-consumer ring
+// without locking and the log writer takes it out in large blocks, so disk never stalls the main loop;
+// what does not fit while the disk lags behind is counted as dropped instead of waited for
+struct _SessionLog {
+    guint8 *ring;
+
+    // Total bytes added and taken out, wrapping; head is written by the main loop only, tail by the writer only
+    guint head;
+    guint tail;
+
+    // Whether the log was stopped, under log_mutex
+    gboolean stopped;
+
+    // The writer's settings, copied when logging started, and the file names it uses
+    LogPolicy policy;
+    gchar *prefix;
+
+    // The open file, how much went into it since when, when it is next flushed and whether anything was
+    // written since the last flush, and whether opening it failed; used by the writer only
+    gzFile file;
+    guint64 file_bytes;
+    gint64 file_time;
+    gint64 flush_time;
+    gboolean unflushed;
+    gboolean failing;
+
+    // Bytes dropped, read by the stats interface, under log_mutex as both threads count them
+    guint64 dropped;
+};
+
+// The one thread writing every log of the process, the logs it serves, and what wakes it: a block ready in a
+// log, a log stopped or the process shutting down
+static GThread *log_writer = NULL;
+static GMutex log_mutex;
+static GCond log_cond;
+static GPtrArray *log_queue = NULL;
+static gboolean log_writer_quit = FALSE;
+
+static gchar* get_log_directory(const LogPolicy *policy) {
+    return policy->directory ? g_strdup(policy->directory) : g_build_filename(g_get_user_data_dir(), "illumiterm", "logs", NULL);
+}
+
+static gzFile open_log_file(SessionLog *log, gboolean quiet) {
+    // Each file is named after the time it was started, with rotation simply starting the next one
+    gchar *directory = get_log_directory(&log->policy);
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *time = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *name = g_strdup_printf("%s-%s.log%s", log->prefix, time, log->policy.compress ? ".gz" : "");
+    gchar *path = g_build_filename(directory, name, NULL);
+    gzFile file = NULL;
+
+    gint fd = g_mkdir_with_parents(directory, 0700) == 0 ? g_open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600) : -1;
+    if (fd >= 0) {
+        file = gzdopen(fd, log->policy.compress ? "ab6" : "abT");
+        if (file) {
+            gzbuffer(file, LOG_BLOCK_SIZE);
+        } else {
+            close(fd);
+        }
+    }
+    if (!file && !quiet) {
+        g_warning("Unable to open the log %s: %s", path, g_strerror(errno));
+    }
+
+    g_free(path);
+    g_free(name);
+    g_free(time);
+    g_date_time_unref(now);
+    g_free(directory);
+    return file;
+}
+
+static void free_session_log(SessionLog *log) {
+    // Closing the file writes the gzip trailer
+    if (log->file) {
+        gzclose(log->file);
+    }
+    g_free(log->prefix);
+    g_free(log->policy.directory);
+    g_free(log->ring);
+    g_free(log);
+}
+
+static void count_log_dropped(SessionLog *log, gsize count) {
+    g_mutex_lock(&log_mutex);
+    log->dropped += count;
+    g_mutex_unlock(&log_mutex);
+}
+
+static guint64 get_log_dropped(SessionLog *log) {
+    g_mutex_lock(&log_mutex);
+    guint64 dropped = log->dropped;
+    g_mutex_unlock(&log_mutex);
+
+    return dropped;
+}
+
+static gboolean is_log_due(SessionLog *log, gint64 now) {
+    guint buffered = g_atomic_int_get(&log->head) - log->tail;
+
+    // A full block, a stopped log, or output or a flush that waited long enough; an idle log costs nothing
+    return buffered >= LOG_BLOCK_SIZE || log->stopped || log_writer_quit ||
+           (now >= log->flush_time && (buffered || log->unflushed));
+}
+
+static void write_log_blocks(SessionLog *log) {
+    guint head = g_atomic_int_get(&log->head);
+    gint64 now = g_get_monotonic_time();
+
+    // Continue in a new file when the current one is full or old enough
+    if (log->file && ((log->policy.rotate_size && log->file_bytes >= log->policy.rotate_size) ||
+                      (log->policy.rotate_time && now - log->file_time >= log->policy.rotate_time))) {
+        gzclose(log->file);
+        log->file = NULL;
+        log->unflushed = FALSE;
+    }
+    // After a failure, try again every interval without repeating the warning
+    if (!log->file && head != log->tail) {
+        log->file = open_log_file(log, log->failing);
+        log->file_bytes = 0;
+        log->file_time = now;
+        log->failing = !log->file;
+    }
+
+    // Write everything buffered in at most two blocks, around the end of the ring; without a file it is lost
+    while (head != log->tail) {
+        guint offset = log->tail & (LOG_RING_SIZE - 1);
+        guint length = MIN(head - log->tail, LOG_RING_SIZE - offset);
+
+        if (log->file && gzwrite(log->file, log->ring + offset, length) != (gint) length) {
+            g_warning("Unable to write the log: %s", g_strerror(errno));
+            gzclose(log->file);
+            log->file = NULL;
+            log->failing = TRUE;
+        }
+        if (log->file) {
+            log->file_bytes += length;
+            log->unflushed = TRUE;
+        } else {
+            count_log_dropped(log, length);
+        }
+        g_atomic_int_set(&log->tail, log->tail + length);
+    }
+
+    // Hand the compressor's and the C library's buffers to the kernel at least once an interval
+    if (log->file && log->unflushed && now >= log->flush_time) {
+        gzflush(log->file, Z_SYNC_FLUSH);
+        log->unflushed = FALSE;
+    }
+    log->flush_time = now + LOG_FLUSH_INTERVAL;
+}
+
+static gpointer run_log_writer(gpointer user_data) {
+    GPtrArray *due = g_ptr_array_new();
+
+    for (;;) {
+        // Sleep until some log has a block ready, waited long enough, or is stopped
+        g_mutex_lock(&log_mutex);
+        for (;;) {
+            gint64 now = g_get_monotonic_time();
+            gint64 wake = now + LOG_FLUSH_INTERVAL;
+
+            g_ptr_array_set_size(due, 0);
+            for (guint i = 0; i < log_queue->len; ++i) {
+                SessionLog *log = g_ptr_array_index(log_queue, i);
+
+                if (is_log_due(log, now)) {
+                    g_ptr_array_add(due, log);
+                } else if (log->flush_time < wake) {
+                    wake = log->flush_time;
+                }
+            }
+            if (due->len || (log_writer_quit && !log_queue->len)) {
+                break;
+            }
+            g_cond_wait_until(&log_cond, &log_mutex, wake);
+        }
+        gboolean quit = log_writer_quit && !log_queue->len;
+        g_mutex_unlock(&log_mutex);
+
+        if (quit) {
+            break;
+        }
+
+        // Write without the lock, the main loop only ever adds logs; a stopped one is drained, then let go
+        for (guint i = 0; i < due->len; ++i) {
+            SessionLog *log = g_ptr_array_index(due, i);
+
+            g_mutex_lock(&log_mutex);
+            gboolean stopped = log->stopped || log_writer_quit;
+            g_mutex_unlock(&log_mutex);
+
+            write_log_blocks(log);
+
+            if (stopped) {
+                g_mutex_lock(&log_mutex);
+                g_ptr_array_remove_fast(log_queue, log);
+                g_mutex_unlock(&log_mutex);
+                free_session_log(log);
+            }
+        }
+    }
+
+    g_ptr_array_unref(due);
+    return NULL;
+}
+
+static void stop_session_log(TerminalData *data);
+
+static void stop_log_writer(GApplication *application, gpointer user_data) {
+    // Finish the logs of the terminals still open, then wait for the writer to close every file, so that
+    // compressed ones get their trailer
+    for (GList *item = terminals; item; item = item->next) {
+        stop_session_log(item->data);
+    }
+
+    g_mutex_lock(&log_mutex);
+    log_writer_quit = TRUE;
+    g_cond_signal(&log_cond);
+    g_mutex_unlock(&log_mutex);
+
+    g_thread_join(log_writer);
+    log_writer = NULL;
+}
+
+static void start_session_log(TerminalData *data) {
+    if (data->log) {
+        return;
+    }
+
+    // Logged the way the invocation that opened the terminal asked
+    const LogPolicy *policy = &data->environment->log;
+    SessionLog *log = g_new0(SessionLog, 1);
+    log->ring = g_malloc(LOG_RING_SIZE);
+    log->policy = *policy;
+    log->policy.directory = g_strdup(policy->directory);
+    log->prefix = g_strdup_printf("illumiterm-%d-%u", getpid(), data->id);
+    log->flush_time = g_get_monotonic_time() + LOG_FLUSH_INTERVAL;
+
+    // The writer owns the log from here and frees it once stopped and drained; it is started with the first
+    // log and joined when the application shuts down
+    data->log = log;
+    g_mutex_lock(&log_mutex);
+    if (!log_writer) {
+        log_queue = g_ptr_array_new();
+        log_writer = g_thread_new("log", run_log_writer, NULL);
+        g_signal_connect(g_application_get_default(), "shutdown", G_CALLBACK(stop_log_writer), NULL);
+    }
+    g_ptr_array_add(log_queue, log);
+    g_mutex_unlock(&log_mutex);
+}
+
+static void stop_session_log(TerminalData *data) {
+    SessionLog *log = data->log;
+
+    if (!log) {
+        return;
+    }
+
+    // Let the writer drain the ring and close the file on its own time
+    data->log = NULL;
+    g_mutex_lock(&log_mutex);
+    log->stopped = TRUE;
+    g_cond_signal(&log_cond);
+    g_mutex_unlock(&log_mutex);
+}
+
+static void write_session_log(SessionLog *log, const guint8 *bytes, gsize count) {
+    guint head = log->head;
+    guint used = head - g_atomic_int_get(&log->tail);
+    guint length = MIN(count, LOG_RING_SIZE - used);
+
+    // Never wait for the writer: output it has no room for is dropped and counted
+    if (length < count) {
+        count_log_dropped(log, count - length);
+    }
+
+    guint offset = head & (LOG_RING_SIZE - 1);
+    guint first = MIN(length, LOG_RING_SIZE - offset);
+    memcpy(log->ring + offset, bytes, first);
+    memcpy(log->ring, bytes + first, length - first);
+    g_atomic_int_set(&log->head, head + length);
+
+    // Wake the writer only when this completes a block, a sleeping writer finds smaller amounts on its timeout
+    if (used < LOG_BLOCK_SIZE && used + length >= LOG_BLOCK_SIZE) {
+        g_mutex_lock(&log_mutex);
+        g_cond_signal(&log_cond);
+        g_mutex_unlock(&log_mutex);
+    }
+}
+
+static void log_committed(VteTerminal *terminal, gchar *text, guint size, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // Typed and pasted input, when the log records both directions
+    if (data->log && data->log->policy.input) {
+        write_session_log(data->log, (const guint8 *) text, size);
+    }
+}
+
+static void apply_log_options(LogPolicy *policy, GVariantDict *options) {
+    const gchar *directory = NULL;
+    gint size, time;
+
+    // Log every terminal of the invocation, into the given directory
+    if (g_variant_dict_lookup(options, "log-dir", "^&ay", &directory)) {
+        g_free(policy->directory);
+        policy->directory = g_strdup(directory);
+        policy->all = TRUE;
+    }
+    if (g_variant_dict_contains(options, "log-input")) {
+        policy->input = TRUE;
+    }
+    if (g_variant_dict_contains(options, "log-compress")) {
+        policy->compress = TRUE;
+    }
+
+    // Rotation limits, given in MiB and minutes
+    if (g_variant_dict_lookup(options, "log-rotate-size", "i", &size) && size >= 0) {
+        policy->rotate_size = (guint64) size * 1024 * 1024;
+    }
+    if (g_variant_dict_lookup(options, "log-rotate-time", "i", &time) && time >= 0) {
+        policy->rotate_time = (gint64) time * 60 * G_USEC_PER_SEC;
+    }
+}
+
+static gboolean check_tab_silence(gpointer user_data) {
+    TerminalData *tab = user_data;
+    gint64 quiet = g_get_monotonic_time() - tab->last_output_time;
+    gint64 timeout = (gint64) terminal_config.silence_timeout * G_USEC_PER_SEC;
+
+    tab->silence_source = 0;
+
+    // Output that came in meanwhile only moved the deadline, wait for the rest of it
+    if (tab->activity == TAB_ACTIVITY_OUTPUT && timeout > 0) {
+        if (quiet >= timeout) {
+            set_tab_activity(tab, TAB_ACTIVITY_SILENCE);
+        } else {
+            tab->silence_source = g_timeout_add((timeout - quiet) / 1000 + 1, check_tab_silence, tab);
+        }
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void track_tab_activity(TerminalData *data, gint64 now) {
+    TerminalData *tab = data->tab ? data->tab : data;
+
+    // The shown tab needs no marks; a hidden one is marked from the byte stream, without being drawn
+    if (!data->throttled) {
+        return;
+    }
+
+    tab->last_output_time = now;
+    set_tab_activity(tab, TAB_ACTIVITY_OUTPUT);
+
+    // One timeout per tab notices when the output stops, however often it arrives
+    if (tab->activity == TAB_ACTIVITY_OUTPUT && terminal_config.silence_timeout > 0 && !tab->silence_source) {
+        tab->silence_source = g_timeout_add_seconds(terminal_config.silence_timeout, check_tab_silence, tab);
+    }
+}
+
+static void track_command_end(TerminalData *data, const guint8 *bytes, gsize count) {
+    const gsize prefix_length = strlen(COMMAND_END_SEQUENCE);
+    const guint8 *end = bytes + count;
+    guint match = data->command_end_match;
+
+    // Look for the end of a command, skipping to the next escape like track_bracketed_paste
+    while (bytes < end) {
+        if (match == 0) {
+            bytes = memchr(bytes, '\033', end - bytes);
+            if (!bytes) {
+                break;
+            }
+            match = 1;
+            ++bytes;
+        } else if (match < prefix_length) {
+            if (*bytes == (guint8) COMMAND_END_SEQUENCE[match]) {
+                ++match;
+                ++bytes;
+            } else {
+                match = 0;
+            }
+        } else if (match == prefix_length && *bytes == ';') {
+            // The exit status follows
+            data->command_status = 0;
+            ++match;
+            ++bytes;
+        } else if (match > prefix_length && g_ascii_isdigit(*bytes)) {
+            data->command_status = MIN(data->command_status * 10 + (*bytes - '0'), 255);
+            ++bytes;
+        } else {
+            // BEL or ESC ends the sequence; without a status the command is taken to have succeeded
+            if (*bytes == '\a' || *bytes == '\033') {
+                if (data->throttled) {
+                    set_tab_activity(data, match > prefix_length && data->command_status ? TAB_ACTIVITY_FAILED : TAB_ACTIVITY_DONE);
+                }
+            }
+            data->command_status = 0;
+            match = 0;
+        }
+    }
+
+    data->command_end_match = match;
+}
+
+static void child_output_received(gpointer user_data, const guint8 *bytes, gsize count) {
+    TerminalData *data = user_data;
+    gint64 now = g_get_monotonic_time();
+
+    // VTE parses it from the relay on its own schedule, in the meantime it is looked at here as it came from the child
+    data->flood_sample_bytes += count;
+    update_output_rate(data, now);
+    track_bracketed_paste(data, bytes, count);
+    track_tab_activity(data, now);
+    track_command_end(data, bytes, count);
+
+    if (data->log) {
+        write_session_log(data->log, bytes, count);
+    }
+}
+
+// What a span of broadcast input is: typed, or the start, text or end of a paste, which each target wraps in
+// bracketed paste markers if it asked for them itself
+typedef enum {
+    BROADCAST_TYPED,
+    BROADCAST_PASTE_START,
+    BROADCAST_PASTED,
+    BROADCAST_PASTE_END
+} BroadcastKind;
+
+// Terminals in the broadcast group, input typed or pasted into one of them gathered this main loop iteration,
+// which of them it came from, and the idle source passing it on to the others
+typedef struct {
+    TerminalData *source;
+    BroadcastKind kind;
+    guint offset;
+    guint length;
+} BroadcastSpan;
+
+static GList *broadcast_terminals;
+static GByteArray *broadcast_buffer;
+static GArray *broadcast_spans;
+static guint broadcast_source;
+
+static void broadcast_input(TerminalData *data, BroadcastKind kind, const void *bytes, gsize length);
+
+static void set_terminal_broadcasting(TerminalData *data, gboolean broadcasting) {
+    if (data->broadcasting == broadcasting) {
+        return;
+    }
+
+    // A paste leaving the group closes in the other terminals first
+    if (!broadcasting && data->broadcast_pasting) {
+        broadcast_input(data, BROADCAST_PASTE_END, NULL, 0);
+    }
+
+    data->broadcasting = broadcasting;
+    if (broadcasting) {
+        broadcast_terminals = g_list_prepend(broadcast_terminals, data);
+    } else {
+        broadcast_terminals = g_list_remove(broadcast_terminals, data);
+    }
+    update_tab_title(data);
+}
+
+static void queue_broadcast_span(TerminalData *data, BroadcastSpan *span) {
+    PtyWriter *writer = &data->input;
+    const guint8 *bytes = broadcast_buffer->data + span->offset;
+    const guint8 *end = bytes + span->length;
+
+    // Pastes are wrapped the way this terminal wants them, and keep no escapes inside the markers
+    if (span->kind == BROADCAST_PASTE_START) {
+        data->broadcast_bracketed = data->bracketed_paste;
+        if (data->broadcast_bracketed) {
+            queue_pty_input(writer, BRACKETED_PASTE_START, strlen(BRACKETED_PASTE_START));
+        }
+    } else if (span->kind == BROADCAST_PASTE_END) {
+        if (data->broadcast_bracketed) {
+            queue_pty_input(writer, BRACKETED_PASTE_END, strlen(BRACKETED_PASTE_END));
+        }
+        data->broadcast_bracketed = FALSE;
+    } else if (span->kind == BROADCAST_PASTED && data->broadcast_bracketed) {
+        for (const guint8 *escape; (escape = memchr(bytes, '\033', end - bytes)); bytes = escape + 1) {
+            queue_pty_input(writer, bytes, escape - bytes);
+        }
+        queue_pty_input(writer, bytes, end - bytes);
+    } else {
+        queue_pty_input(writer, bytes, end - bytes);
+    }
+}
+
+static gboolean flush_broadcast(gpointer user_data) {
+    GList *item = broadcast_terminals;
+
+    // Each target gets everything the other members sent at once, with a single write attempt; one that
+    // does not keep up buffers on its own, and is dropped if it stops reading altogether
+    while (item) {
+        TerminalData *data = item->data;
+        PtyWriter *writer = &data->input;
+        gboolean queued = FALSE;
+        item = item->next;
+
+        for (guint i = 0; i < broadcast_spans->len && writer->buffer; ++i) {
+            BroadcastSpan *span = &g_array_index(broadcast_spans, BroadcastSpan, i);
+
+            if (span->source != data) {
+                queue_broadcast_span(data, span);
+                queued = TRUE;
+            }
+        }
+        if (queued) {
+            flush_pty_input(writer);
+        }
+        if (get_pending_pty_input(writer) > BROADCAST_BUFFER_LIMIT) {
+            g_warning("Terminal %u stopped reading its input, it no longer receives broadcast input", data->id);
+
+            // Still close a paste it was in the middle of, for whenever it reads again
+            if (data->broadcast_bracketed) {
+                write_pty_input(writer, BRACKETED_PASTE_END, strlen(BRACKETED_PASTE_END));
+                data->broadcast_bracketed = FALSE;
+            }
+            set_terminal_broadcasting(data, FALSE);
+        }
+    }
+
+    g_byte_array_set_size(broadcast_buffer, 0);
+    g_array_set_size(broadcast_spans, 0);
+    broadcast_source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+static void broadcast_input(TerminalData *data, BroadcastKind kind, const void *bytes, gsize length) {
+    if (!data->broadcasting || (!length && (kind == BROADCAST_TYPED || kind == BROADCAST_PASTED))) {
+        return;
+    }
+
+    if (!broadcast_buffer) {
+        broadcast_buffer = g_byte_array_sized_new(PTY_CHUNK_SIZE);
+        broadcast_spans = g_array_new(FALSE, FALSE, sizeof(BroadcastSpan));
+    }
+
+    // Follow whether the targets are in the middle of a paste of this terminal
+    if (kind == BROADCAST_PASTE_START || kind == BROADCAST_PASTE_END) {
+        data->broadcast_pasting = kind == BROADCAST_PASTE_START;
+    }
+
+    // Typed or pasted text from the same terminal in a row makes one span
+    BroadcastSpan *last = broadcast_spans->len ? &g_array_index(broadcast_spans, BroadcastSpan, broadcast_spans->len - 1) : NULL;
+    if (last && last->source == data && last->kind == kind && (kind == BROADCAST_TYPED || kind == BROADCAST_PASTED)) {
+        last->length += length;
+    } else {
+        BroadcastSpan span = { data, kind, broadcast_buffer->len, length };
+        g_array_append_val(broadcast_spans, span);
+    }
+    g_byte_array_append(broadcast_buffer, bytes, length);
+
+    // Pass it on once the events of this iteration are all in, ahead of output like the input itself
+    if (!broadcast_source) {
+        broadcast_source = g_idle_add_full(G_PRIORITY_HIGH, flush_broadcast, NULL, NULL);
+    }
+}
+
+static gboolean is_typed_input() {
+    // Keys are committed while their event is handled, replies to the program while its output is processed
+    GdkEvent *event = gtk_get_current_event();
+    GdkEventType type = event ? gdk_event_get_event_type(event) : GDK_NOTHING;
+
+    if (event) {
+        gdk_event_free(event);
+    }
+
+    return type == GDK_KEY_PRESS || type == GDK_KEY_RELEASE;
+}
+
+static void forget_broadcast_terminal(TerminalData *data) {
+    // Leave the group without touching the label, which may be going away too, and drop the terminal
+    // from input still waiting to be broadcast
+    if (data->broadcasting) {
+        data->broadcasting = FALSE;
+        broadcast_terminals = g_list_remove(broadcast_terminals, data);
+    }
+    for (guint i = 0; broadcast_spans && i < broadcast_spans->len; ++i) {
+        BroadcastSpan *span = &g_array_index(broadcast_spans, BroadcastSpan, i);
+
+        if (span->source == data) {
+            span->source = NULL;
+        }
+    }
+}
+
+struct _PasteJob {
+    // The tab pasted into, NULL once it went away while the clipboard was still being read
+    TerminalData *data;
+
+    // Clipboard text, its length and how much of it has been written
+    gchar *text;
+    gsize length;
+    gsize offset;
+
+    // Whether the paste is wrapped in bracketed paste markers, and whether the last byte written was a CR
+    gboolean bracketed;
+    gboolean last_cr;
+
+    // Input committed while the paste is written, held back until it is complete so that it does not end up
+    // in the middle of the pasted text, and what of it was typed, for the broadcast group; or NULL
+    GByteArray *held;
+    GByteArray *held_typed;
+
+    // Idle source writing the next chunk
+    guint source;
+
+    // Progress shown for large pastes, or NULL
+    GtkWidget *popover;
+    GtkWidget *progress;
+};
+
+static void free_paste_job(PasteJob *job) {
+    if (job->source) {
+        g_source_remove(job->source);
+    }
+    if (job->popover) {
+        gtk_widget_destroy(job->popover);
+    }
+    if (job->held) {
+        g_byte_array_unref(job->held);
+    }
+    if (job->held_typed) {
+        g_byte_array_unref(job->held_typed);
+    }
+    g_free(job->text);
+    g_free(job);
+}
+
+static void finish_paste(TerminalData *data) {
+    PasteJob *job = data->paste;
+
+    // Close the bracket even when cancelled, so that the shell does not keep waiting for the end of the paste,
+    // in the broadcast group too
+    if (job->bracketed) {
+        write_pty_input(&data->input, BRACKETED_PASTE_END, strlen(BRACKETED_PASTE_END));
+    }
+    if (data->broadcast_pasting) {
+        broadcast_input(data, BROADCAST_PASTE_END, NULL, 0);
+    }
+
+    // Then what was typed meanwhile
+    if (job->held) {
+        write_pty_input(&data->input, job->held->data, job->held->len);
+    }
+    if (job->held_typed) {
+        broadcast_input(data, BROADCAST_TYPED, job->held_typed->data, job->held_typed->len);
+    }
+
+    data->paste = NULL;
+    free_paste_job(job);
+}
+
+static void cancel_paste(TerminalData *data) {
+    PasteJob *job = data->paste;
+
+    if (!job) {
+        return;
+    }
+
+    if (!job->text) {
+        // The clipboard is still being read, its callback frees the job
+        job->data = NULL;
+        data->paste = NULL;
+        return;
+    }
+
+    finish_paste(data);
+}
+
+static gboolean write_paste_chunk(gpointer user_data) {
+    PasteJob *job = user_data;
+    TerminalData *data = job->data;
+    PtyWriter *writer = &data->input;
+
+    if (!writer->buffer) {
+        // The child is gone
+        job->source = 0;
+        cancel_paste(data);
+        return G_SOURCE_REMOVE;
+    }
+
+    // Top the input queue up to one chunk, so that keystrokes typed meanwhile wait for no more than that;
+    // line feeds become carriage returns like Enter sends, and with the bracket open escapes are dropped
+    // so that the text cannot close it early
+    gsize pending = get_pending_pty_input(writer);
+    gsize span = pending < PASTE_CHUNK_SIZE ? MIN(job->length - job->offset, PASTE_CHUNK_SIZE - pending) : 0;
+    const gchar *text = job->text + job->offset;
+    guint8 *start = extend_pty_input(writer, span);
+    guint8 *out = start;
+    for (gsize i = 0; i < span; ++i) {
+        guint8 c = text[i];
+        gboolean after_cr = job->last_cr;
+
+        job->last_cr = c == '\r';
+        if (c == '\n') {
+            if (after_cr) {
+                continue;
+            }
+            c = '\r';
+        }
+        *out++ = c;
+    }
+
+    // The broadcast group gets the text with its escapes, each of them drops them only inside its own bracket
+    broadcast_input(data, BROADCAST_PASTED, start, out - start);
+    if (job->bracketed) {
+        guint8 *kept = start;
+
+        for (guint8 *c = start; c < out; ++c) {
+            if (*c != '\033') {
+                *kept++ = *c;
+            }
+        }
+        out = kept;
+    }
+    g_byte_array_set_size(writer->buffer, out - writer->buffer->data);
+    job->offset += span;
+
+    if (job->progress) {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress), (gdouble) job->offset / job->length);
+    }
+
+    flush_pty_input(writer);
+
+    if (job->offset == job->length) {
+        job->source = 0;
+        finish_paste(data);
+        return G_SOURCE_REMOVE;
+    }
+    if (get_pending_pty_input(writer) >= PASTE_CHUNK_SIZE) {
+        // The child is not keeping up, continue once it took everything (paste_input_drained)
+        job->source = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void paste_input_drained(gpointer user_data) {
+    TerminalData *data = user_data;
+    PasteJob *job = data->paste;
+
+    // Resume a paste waiting for the child to read
+    if (job && job->text && !job->source) {
+        job->source = g_idle_add(write_paste_chunk, job);
+    }
+}
+
+static void child_input_committed(VteTerminal *terminal, gchar *text, guint size, gpointer user_data) {
+    TerminalData *data = user_data;
+    PasteJob *job = data->paste;
+
+    // Only what is typed goes to the broadcast group, replies are for this terminal's program alone
+    gboolean typed = data->broadcasting && is_typed_input();
+
+    // Input committed while a paste is being written follows the paste
+    if (job && job->text) {
+        if (!job->held) {
+            job->held = g_byte_array_new();
+        }
+        g_byte_array_append(job->held, (const guint8 *) text, size);
+        if (typed) {
+            if (!job->held_typed) {
+                job->held_typed = g_byte_array_new();
+            }
+            g_byte_array_append(job->held_typed, (const guint8 *) text, size);
+        }
+        return;
+    }
+
+    // Otherwise keyboard input and replies go straight to the child, behind input still queued for it
+    write_pty_input(&data->input, text, size);
+    if (typed) {
+        broadcast_input(data, BROADCAST_TYPED, text, size);
+    }
+}
+
+static void on_paste_cancel_clicked(GtkButton *button, gpointer user_data) {
+    PasteJob *job = user_data;
+
+    cancel_paste(job->data);
+}
+
+static void show_paste_progress(PasteJob *job) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *cancel_button = gtk_button_new_with_label("Cancel");
+
+    job->progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(job->progress), "Pasting");
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(job->progress), TRUE);
+    gtk_widget_set_valign(job->progress, GTK_ALIGN_CENTER);
+    g_signal_connect(cancel_button, "clicked", G_CALLBACK(on_paste_cancel_clicked), job);
+
+    gtk_container_set_border_width(GTK_CONTAINER(box), 6);
+    gtk_box_pack_start(GTK_BOX(box), job->progress, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(box), cancel_button, FALSE, FALSE, 0);
+    gtk_widget_show_all(box);
+
+    // Not modal, the terminal stays usable while the paste goes on
+    job->popover = gtk_popover_new(GTK_WIDGET(job->data->terminal));
+    gtk_popover_set_modal(GTK_POPOVER(job->popover), FALSE);
+    gtk_container_add(GTK_CONTAINER(job->popover), box);
+    gtk_popover_popup(GTK_POPOVER(job->popover));
+}
+
+static void paste_text_received(GtkClipboard *clipboard, const gchar *text, gpointer user_data) {
+    PasteJob *job = user_data;
+    TerminalData *data = job->data;
+
+    if (!data || !text || !*text || !data->input.buffer) {
+        // The tab went away, or there is nothing to paste
+        if (data) {
+            data->paste = NULL;
+        }
+        free_paste_job(job);
+        return;
+    }
+
+    job->text = g_strdup(text);
+    job->length = strlen(text);
+    job->bracketed = data->bracketed_paste;
+
+    if (job->length > PASTE_PROGRESS_THRESHOLD) {
+        show_paste_progress(job);
+    }
+
+    if (job->bracketed) {
+        write_pty_input(&data->input, BRACKETED_PASTE_START, strlen(BRACKETED_PASTE_START));
+    }
+    broadcast_input(data, BROADCAST_PASTE_START, NULL, 0);
+
+    // Write the text in chunks from the main loop, keeping the window responsive
+    job->source = g_idle_add(write_paste_chunk, job);
+}
+
+static void start_paste(TerminalData *data) {
+    // One paste at a time per tab
+    if (data->paste || !data->terminal || !data->input.buffer) {
+        return;
+    }
+
+    data->paste = g_new0(PasteJob, 1);
+    data->paste->data = data;
+    gtk_clipboard_request_text(gtk_widget_get_clipboard(GTK_WIDGET(data->terminal), GDK_SELECTION_CLIPBOARD),
+        paste_text_received,
+        data->paste);
+}
+
+static void release_pty(GtkWidget *widget, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // Abandon a paste in progress, stop taking part in broadcasts and finish the log
+    cancel_paste(data);
+    forget_broadcast_terminal(data);
+    forget_startup_terminal(data);
+    stop_session_log(data);
+
+    // Stop watching for the end of a flood
+    if (data->flood_source) {
+        g_source_remove(data->flood_source);
+        data->flood_source = 0;
+    }
+    data->flooding = FALSE;
+
+    close_terminal_ptys(data);
+}
+
+static void reap_child(GPid pid, gint status, gpointer user_data) {
+    g_spawn_close_pid(pid);
+}
+
+static void close_terminal_ptys(TerminalData *data) {
+    // Drop a spawn still in progress
+    g_cancellable_cancel(data->spawn_cancellable);
+    g_clear_object(&data->spawn_cancellable);
+
+    // Stop waiting for the child, only reaping it once it is gone, stop reading and writing, and hang it up
+    // by closing its PTY
+    if (data->child_watch) {
+        g_source_remove(data->child_watch);
+        data->child_watch = 0;
+        g_child_watch_add(data->child_pid, reap_child, NULL);
+    }
+    stop_pty_output(&data->output);
+    stop_pty_input(&data->input);
+    g_clear_object(&data->pty);
+
+    // Let go of the relay as well
+    stop_pty_input(&data->relay_output);
+    if (data->relay_input_source) {
+        g_source_remove(data->relay_input_source);
+        data->relay_input_source = 0;
+    }
+    if (data->relay) {
+        close(data->relay_fd);
+        g_clear_object(&data->relay);
+    }
+}
+
+static gboolean relay_input_readable(gint fd, GIOCondition condition, gpointer user_data) {
+    // Only ever used from the main loop
+    static guint8 discarded[PTY_CHUNK_SIZE];
+
+    // VTE writes what it commits to its PTY too; the child got it from the "commit" handler already
+    while (read(fd, discarded, sizeof discarded) > 0) {
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean sync_relay_erase(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
+    TerminalData *data = user_data;
+    struct termios child, relay;
+
+    // VTE picks what Backspace sends from the erase character of its PTY, which is the child's to set; this
+    // runs before VTE handles the key
+    if (event->keyval == GDK_KEY_BackSpace && data->pty && data->relay &&
+        tcgetattr(vte_pty_get_fd(data->pty), &child) == 0 && tcgetattr(data->relay_fd, &relay) == 0 &&
+        child.c_cc[VERASE] != relay.c_cc[VERASE]) {
+        relay.c_cc[VERASE] = child.c_cc[VERASE];
+        tcsetattr(data->relay_fd, TCSANOW, &relay);
+    }
+
+    return FALSE;
+}
+
+static void start_child(TerminalData *data) {
+    // Spawn the child asynchronously
+    begin_startup_phase(data, STARTUP_SPAWN);
+    data->spawn_cancellable = g_cancellable_new();
+    vte_pty_spawn_async(data->pty,
+        data->cwd,
+        data->argv,
+        data->environment->envv,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        -1,
+        data->spawn_cancellable,
+        child_spawned,
+        data);
+}
+
+static gboolean open_terminal_ptys(TerminalData *data, GError **error) {
+    // The child gets a PTY of its own, which VTE never sees
+    data->pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, error);
+    if (!data->pty) {
+        return FALSE;
+    }
+
+    // VTE would tell the line discipline which encoding to erase characters in had it the PTY
+    if (!vte_pty_set_utf8(data->pty, TRUE, error)) {
+        g_warning("Unable to set the terminal PTY to UTF-8: %s", (*error)->message);
+        g_clear_error(error);
+    }
+    g_unix_set_fd_nonblocking(vte_pty_get_fd(data->pty), TRUE, NULL);
+
+    // VTE reads the relay, whose other side passes every byte through unchanged and echoes nothing
+    VtePty *relay = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, error);
+    gint fd = relay ? ioctl(vte_pty_get_fd(relay), TIOCGPTPEER, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC) : -1;
+    if (relay && fd < 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno), "Unable to open the relay PTY: %s", g_strerror(errno));
+    }
+    if (fd < 0) {
+        g_clear_object(&relay);
+        g_clear_object(&data->pty);
+        return FALSE;
+    }
+
+    struct termios attributes;
+    if (tcgetattr(fd, &attributes) == 0) {
+        cfmakeraw(&attributes);
+        tcsetattr(fd, TCSANOW, &attributes);
+    }
+    data->relay = relay;
+    data->relay_fd = fd;
+    vte_terminal_set_pty(data->terminal, relay);
+
+    return TRUE;
+}
+
+static void spawn_child(TerminalData *data) {
+    GError *error = NULL;
+
+    // The child's PTY and the relay VTE reads, which a pooled terminal has already
+    if (!data->pty && !open_terminal_ptys(data, &error)) {
+        g_warning("Unable to set up the terminal PTY: %s", error->message);
+        forget_startup_terminal(data);
+        close_terminal_tab(data, error->code);
+        g_error_free(error);
+        return;
+    }
+    g_signal_connect(data->terminal, "destroy", G_CALLBACK(release_pty), data);
+
+    // Pass child output on to VTE as it is read, watching its rate, and as long as VTE keeps up with it; send
+    // what VTE commits, keyboard input and replies alike, to the child at once, and ahead of output, so
+    // that Ctrl+C gets through even while output floods in
+    gint fd = vte_pty_get_fd(data->pty);
+    data->output.received = child_output_received;
+    data->input.drained = paste_input_drained;
+    start_pty_input(&data->relay_output, data->relay_fd, &data->output);
+    start_pty_output(&data->output, fd, G_PRIORITY_DEFAULT, &data->relay_output, data);
+    start_pty_input(&data->input, fd, data);
+    data->relay_input_source = g_unix_fd_add(data->relay_fd, G_IO_IN, relay_input_readable, NULL);
+    g_signal_connect(data->terminal, "key-press-event", G_CALLBACK(sync_relay_erase), data);
+    g_signal_connect(data->terminal, "commit", G_CALLBACK(child_input_committed), data);
+    g_signal_connect(data->terminal, "commit", G_CALLBACK(log_committed), data);
+
+    // Log from the first byte when the invocation logs all its terminals
+    if (data->environment->log.all) {
+        start_session_log(data);
+    }
+
+    // Start the child at the terminal's size and follow its resizes
+    resize_child_pty(data);
+    g_signal_connect_after(data->terminal, "size-allocate", G_CALLBACK(sync_pty_size), data);
+    g_signal_connect_after(data->terminal, "draw", G_CALLBACK(count_terminal_frame), data);
+
+    // Spawn the child, unless it is a pooled shell already started or on its way
+    if (!data->child_pid && !data->spawn_cancellable) {
+        start_child(data);
+    }
+}
+
+static void apply_memory_options(GApplicationCommandLine *cli, GVariantDict *options) {
+    gint cap, floor;
+    gboolean given = g_variant_dict_contains(options, "scrollback-memory-cap") || g_variant_dict_contains(options, "memory-trim-floor");
+
+    // These budget the memory of the whole process, so only the invocation starting it sets them
+    if (g_application_command_line_get_is_remote(cli)) {
+        if (given) {
+            g_application_command_line_printerr(cli, "illumiterm: --scrollback-memory-cap and --memory-trim-floor only apply when starting IllumiTerm\n");
+        }
+        return;
+    }
+
+    // Process-wide cap for in-memory scrollback, given in MiB
+    if (g_variant_dict_lookup(options, "scrollback-memory-cap", "i", &cap) && cap > 0) {
+        scrollback_memory_cap = (gsize) cap * 1024 * 1024;
+    }
+
+    // History idle background terminals keep when memory runs out
+    if (g_variant_dict_lookup(options, "memory-trim-floor", "i", &floor)) {
+        memory_trim_floor = floor;
+    }
+}
+
+static void apply_scrollback_options(Environment *environment, GVariantDict *options) {
+    gint lines;
+
+    // Size of the hot in-memory ring of every terminal this invocation opens
+    if (g_variant_dict_lookup(options, "scrollback-lines", "i", &lines)) {
+        environment->scrollback.lines = lines;
+    }
+
+    // Whether lines leaving the screen are also kept in a compressed file
+    if (g_variant_dict_contains(options, "scrollback-spill")) {
+        environment->scrollback.spill = TRUE;
+    }
+}
+
+static void restore_session_history(TerminalData *data) {
+    // Only tabs restored with history have chunks before their terminal exists
+    if (!data->session_chunks || data->session_chunks->len == 0) {
+        return;
+    }
+
+    // Map the log rather than read it, only the pages holding this tab's chunks are touched
+    GError *error = NULL;
+    GMappedFile *file = g_mapped_file_new(session_path, FALSE, &error);
+    if (!file) {
+        g_warning("Unable to read the session history: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    const guint8 *contents = (const guint8 *) g_mapped_file_get_contents(file);
+    gsize length = g_mapped_file_get_length(file);
+    GByteArray *text = g_byte_array_new();
+    GString *lines = g_string_new(NULL);
+    glong rows = 0;
+
+    for (guint i = 0; i < data->session_chunks->len; ++i) {
+        SessionChunk *chunk = &g_array_index(data->session_chunks, SessionChunk, i);
+
+        // Skip the type, length, tab and text length, then inflate
+        if (chunk->offset + chunk->length > length || chunk->length < 13) {
+            continue;
+        }
+        uLongf text_length = chunk->text_length;
+        g_byte_array_set_size(text, text_length);
+        if (uncompress(text->data, &text_length, contents + chunk->offset + 13, chunk->length - 13) != Z_OK) {
+            continue;
+        }
+
+        // The text has bare newlines, the terminal needs a carriage return as well
+        g_string_truncate(lines, 0);
+        for (uLongf j = 0; j < text_length; ++j) {
+            if (text->data[j] == '\n') {
+                g_string_append_c(lines, '\r');
+                rows++;
+            }
+            g_string_append_c(lines, text->data[j]);
+        }
+        vte_terminal_feed(data->terminal, lines->str, lines->len);
+    }
+
+    // These rows are in the log already
+    data->spilled_row = rows;
+
+    g_string_free(lines, TRUE);
+    g_byte_array_unref(text);
+    g_mapped_file_unref(file);
+}
+
+static void create_terminal_widget(TerminalData *data) {
+    // Create the VteTerminal widget and make the tab state reachable from it
+    GtkWidget *widget = vte_terminal_new();
+    data->terminal = VTE_TERMINAL(widget);
+    g_object_set_data(G_OBJECT(widget), "terminal-data", data);
+
+    // Fill the page with the terminal, which scrolls its own buffer, next to a scrollbar driving it
+    GtkWidget *scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(widget)));
+    data->pane = data->page;
+    gtk_box_pack_start(GTK_BOX(data->pane), widget, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(data->pane), scrollbar, FALSE, FALSE, 0);
+    gtk_widget_show(widget);
+    gtk_widget_show(scrollbar);
+
+    // Connect the VteTerminal signals to their corresponding handlers
+    connect_vte_signals(widget, data);
+
+    // Apply the settings of the configuration file, read once for all terminals
+    apply_terminal_config(data->terminal, &terminal_config, NULL);
+}
+
+static void instantiate_terminal(TerminalData *data) {
+    // A tab gets its child process only once
+    if (data->started) {
+        return;
+    }
+    data->started = TRUE;
+
+    // With --profile-startup, the first terminal started for the window is the one timed
+    claim_startup_terminal(data);
+    begin_startup_phase(data, STARTUP_FONT_SETUP);
+
+    // A pooled terminal comes with its widget
+    if (!data->terminal) {
+        create_terminal_widget(data);
+    }
+
+    // Bound the scrollback of the terminal according to the scrollback policy
+    setup_scrollback(data);
+
+    // Spawn the child on a PTY whose output is fed to the VteTerminal
+    spawn_child(data);
+
+    // Bring back the history the tab had in the last session ahead of the child's output
+    restore_session_history(data);
+
+    // The terminal may already know a title
+    update_tab_title(data);
+
+    // Have the first zoom steps measured
+    schedule_font_measuring(data->terminal);
+}
+
+static void free_terminal_data(gpointer user_data) {
+    TerminalData *data = user_data;
+
+    // Stop measuring fonts for a terminal that is gone, and waiting for it to go silent
+    if (data->font_measure_source) {
+        g_source_remove(data->font_measure_source);
+    }
+    if (data->silence_source) {
+        g_source_remove(data->silence_source);
+    }
+
+    // Free the spawn parameters and the tab name
+    g_free(data->cwd);
+    g_strfreev(data->argv);
+    if (data->environment) {
+        unref_environment(data->environment);
+    }
+    g_free(data->custom_title);
+    g_list_free(data->panes);
+    if (data->session_chunks) {
+        g_array_unref(data->session_chunks);
+    }
+
+    g_free(data);
+}
+
+static const gchar* get_shell_path(Environment *environment) {
+    // The user's shell, falling back to /bin/sh when $SHELL is not set
+    const gchar *shell = g_environ_getenv(environment->envv, "SHELL");
+
+    return shell ? shell : "/bin/sh";
+}
+
+static gchar** get_shell_argv(Environment *environment) {
+    // Run the user's shell
+    return g_strdupv((gchar *[]){(gchar *) get_shell_path(environment), NULL});
+}
+
+static gboolean is_shell_argv(gchar **argv, Environment *environment) {
+    // A tab running the shell on its own is idle at its prompt, one running a command is busy until it ends
+    return argv && argv[0] && !argv[1] && g_strcmp0(argv[0], get_shell_path(environment)) == 0;
+}
+
+static TerminalData* new_terminal_data(const gchar *cwd, gchar **argv, Environment *environment) {
+    // Create the tab state; it takes ownership of the argument vector and of one environment reference
+    TerminalData *data = g_new0(TerminalData, 1);
+    data->id = next_terminal_id++;
+    data->cwd = g_strdup(cwd);
+    data->argv = argv;
+    data->environment = environment;
+    data->login_shell = is_shell_argv(argv, environment);
+
+    // Nothing is read before the child's PTY is opened and its child spawned
+    data->output.fd = -1;
+
+    // The page only holds a placeholder box until the tab is first shown
+    data->page = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    g_object_set_data_full(G_OBJECT(data->page), "terminal-data", data, free_terminal_data);
+
+    return data;
+}
+
+static void session_tab_closed(GtkWidget *page, gpointer user_data) {
+    TerminalData *data = user_data;
+
+    if (!gtk_widget_in_destruction(data->window)) {
+        record_session_closed('C', data->id);
+    }
+}
+
+static void attach_terminal_tab(WindowData *window_data, TerminalData *data) {
+    // The tab now belongs to this window
+    data->window = window_data->window;
+
+    // Add the page with its label to the notebook
+    data->label = gtk_label_new(get_tab_title(data));
+    gtk_notebook_append_page(GTK_NOTEBOOK(window_data->notebook), data->page, data->label);
+    gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(window_data->notebook), data->page, TRUE);
+    gtk_widget_show(data->page);
+
+    // Record the tab in the session, and its closing unless the whole window goes
+    record_session_tab(data);
+    g_signal_connect(data->page, "destroy", G_CALLBACK(session_tab_closed), data);
+}
+
+static TerminalData* create_terminal_tab(WindowData *window_data, const gchar *cwd, gchar **argv, Environment *environment) {
+    // Create the tab state and add its page to the window
+    TerminalData *data = new_terminal_data(cwd, argv, environment);
+    attach_terminal_tab(window_data, data);
+
+    return data;
+}
+
+static gchar** get_command_argv(const gchar *command, Environment *environment) {
+    // Run a command line through the shell, or the user's shell without one
+    return command ?
+        g_strdupv((gchar *[]){"/bin/sh", "-c", (gchar *) command, NULL}) :
+        get_shell_argv(environment);
+}
+
+// Started tab, defined together with the terminal pool below
+static TerminalData* open_terminal_tab(WindowData *window_data, const gchar *cwd, gchar **argv, Environment *environment);
+
+static TerminalData* open_terminal_tab_from_cli(WindowData *window_data, GApplicationCommandLine *cli, Environment *environment, const gchar *command) {
+    // Start the tab in the directory the command line was run from, sharing the invocation's environment
+    return open_terminal_tab(window_data, g_application_command_line_get_cwd(cli), get_command_argv(command, environment), ref_environment(environment));
+}
+
+static gchar** read_batch_commands(GApplicationCommandLine *cli, const gchar *path) {
+    // The file name is relative to the directory the command line was run from
+    GFile *file = g_application_command_line_create_file_for_arg(cli, path);
+    gchar *contents = NULL;
+    GError *error = NULL;
+
+    if (!g_file_load_contents(file, NULL, &contents, NULL, NULL, &error)) {
+        g_application_command_line_printerr(cli, "illumiterm: %s\n", error->message);
+        g_error_free(error);
+        g_object_unref(file);
+        return NULL;
+    }
+    g_object_unref(file);
+
+    // One command per line, skipping blank lines and # comments
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    GPtrArray *commands = g_ptr_array_new();
+    g_free(contents);
+
+    for (gchar **line = lines; *line; ++line) {
+        gchar *command = g_strstrip(*line);
+
+        if (*command && *command != '#') {
+            g_ptr_array_add(commands, g_strdup(command));
+        }
+    }
+    g_strfreev(lines);
+
+    if (commands->len == 0) {
+        g_application_command_line_printerr(cli, "illumiterm: no commands in %s\n", path);
+        g_ptr_array_free(commands, TRUE);
+        return NULL;
+    }
+
+    g_ptr_array_add(commands, NULL);
+    return (gchar **) g_ptr_array_free(commands, FALSE);
+}
+
+static void open_batch_tabs(WindowData *window_data, GApplicationCommandLine *cli, Environment *environment, gchar **commands) {
+    // All tabs share the window, and with it the style and the font metrics VTE caches per font
+    for (gchar **command = commands; *command; ++command) {
+        // Start every terminal right away rather than on first show; the spawns run concurrently
+        open_terminal_tab_from_cli(window_data, cli, environment, *command);
+    }
+
+    // Start out on the first tab
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(window_data->notebook), 0);
+}
+
+static TerminalData* get_current_tab(WindowData *window_data) {
+    // Look up the state of the page shown in the notebook
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    GtkWidget *page = gtk_notebook_get_nth_page(notebook, gtk_notebook_get_current_page(notebook));
+
+    return page ? g_object_get_data(G_OBJECT(page), "terminal-data") : NULL;
+}
+
+static TerminalData* get_current_pane(WindowData *window_data) {
+    // The pane of the shown tab that last had the focus
+    TerminalData *tab = get_current_tab(window_data);
+
+    return tab && tab->active_pane ? tab->active_pane : tab;
+}
+
+static gchar* get_terminal_cwd(TerminalData *data) {
+    // Prefer the directory the shell reported through OSC 7
+    const gchar *uri = data->terminal ? vte_terminal_get_current_directory_uri(data->terminal) : NULL;
+    gchar *cwd = uri ? g_filename_from_uri(uri, NULL, NULL) : NULL;
+
+    // Fall back to the directory the terminal was started in
+    return cwd ? cwd : g_strdup(data->cwd);
+}
+
+static void set_terminal_throttled(TerminalData *data, gboolean throttled) {
+    if (data->throttled == throttled) {
+        return;
+    }
+
+    // The terminal keeps parsing its output either way: the notebook unmaps the pages it does not show, and
+    // a minimized window has its updates frozen (update_terminal_throttling), both draw the current screen once
+    // shown again; what is left here is what a tab nobody looks at does differently
+    data->throttled = throttled;
+
+    // A tab shown again has been seen, whatever it did meanwhile
+    if (!throttled) {
+        clear_tab_activity(data);
+    }
+
+    // A terminal trimmed under memory pressure gets its full budget again once it is in use
+    if (!throttled && data->scrollback_limit) {
+        data->scrollback_limit = 0;
+        rebalance_scrollback();
+    }
+}
+
+static void update_terminal_throttling(WindowData *window_data) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    gint current = gtk_notebook_get_current_page(notebook);
+
+    // Only the shown tab of a window that is not minimized renders
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+        TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+
+        if (data->terminal) {
+            set_terminal_throttled(data, i != current || window_data->suspended);
+        }
+        for (GList *pane = data->panes; pane; pane = pane->next) {
+            set_terminal_throttled(pane->data, i != current || window_data->suspended);
+        }
+    }
+
+    // Nothing of a minimized window is painted; the areas invalidated meanwhile are painted at once when it is
+    // restored
+    GdkWindow *window = gtk_widget_get_window(window_data->window);
+    if (window && window_data->suspended != window_data->suspend_frozen) {
+        if (window_data->suspended) {
+            gdk_window_freeze_updates(window);
+        } else {
+            gdk_window_thaw_updates(window);
+        }
+        window_data->suspend_frozen = window_data->suspended;
+    }
+
+    // Only a flood in a rendered terminal caps the frame rate
+    update_frame_cap(window_data);
+}
+
+static gboolean window_state_changed(GtkWidget *window, GdkEventWindowState *event, gpointer user_data) {
+    WindowData *window_data = get_window_data(window);
+    gboolean suspended = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) != 0;
+
+    // Stop rendering while minimized, and catch up once when restored
+    if (suspended != window_data->suspended) {
+        window_data->suspended = suspended;
+        update_terminal_throttling(window_data);
+    }
+
+    return FALSE;
+}
+
+static void switch_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer user_data) {
+    TerminalData *data = g_object_get_data(G_OBJECT(page), "terminal-data");
+
+    // Pages shown while the window is torn down or detached must not start a terminal
+    if (gtk_widget_in_destruction(GTK_WIDGET(notebook)) || get_window_data(data->window)->detaching) {
+        return;
+    }
+
+    // Start the terminal of a tab the first time it is shown
+    instantiate_terminal(data);
+
+    // Render the shown tab and stop rendering the one that was shown before
+    WindowData *window_data = get_window_data(data->window);
+    update_terminal_throttling(window_data);
+
+    // An open find bar searches the shown tab
+    if (window_data->find_bar && gtk_revealer_get_reveal_child(GTK_REVEALER(window_data->find_bar))) {
+        start_search(window_data);
+    }
+
+    // The window title follows the tab that is shown
+    set_window_title(data->window, get_tab_title(data));
+
+    // Keyboard input goes to the pane of the shown tab that last had the focus, like get_current_pane
+    gtk_widget_grab_focus(GTK_WIDGET(data->active_pane ? data->active_pane->terminal : data->terminal));
+}
+
+static void update_show_tabs(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
+    // Only show the tab bar when there is more than one tab
+    gtk_notebook_set_show_tabs(notebook, gtk_notebook_get_n_pages(notebook) > 1);
+}
+
+static TerminalData* create_pooled_terminal() {
+    // Start the shell in the directory and environment the last tab asked for; the output waits in the PTY
+    // until a tab takes the terminal, and a tab asking for anything else has its child spawned then
+    Environment *environment = terminal_pool_environment;
+    TerminalData *data = environment ?
+        new_terminal_data(terminal_pool_cwd, get_shell_argv(environment), ref_environment(environment)) :
+        new_terminal_data(g_get_home_dir(), NULL, NULL);
+
+    // The pool owns the page until a window takes it
+    g_object_ref_sink(data->page);
+
+    // Build the widget with its fonts, and open its PTYs, right away
+    create_terminal_widget(data);
+
+    GError *error = NULL;
+    if (!open_terminal_ptys(data, &error)) {
+        g_warning("Unable to set up the PTY of a pooled terminal: %s", error->message);
+        g_error_free(error);
+    } else if (environment) {
+        resize_child_pty(data);
+        start_child(data);
+    }
+
+    return data;
+}
+
+static gboolean refill_terminal_pool(gpointer user_data) {
+    // Prepare one terminal per idle iteration so each step stays short
+    if (g_queue_get_length(&terminal_pool) < TERMINAL_POOL_SIZE) {
+        g_queue_push_tail(&terminal_pool, create_pooled_terminal());
+    }
+
+    // Keep going until the pool is full
+    if (g_queue_get_length(&terminal_pool) < TERMINAL_POOL_SIZE) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    terminal_pool_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_terminal_pool_refill() {
+    // Refill in the background, after any pending input and drawing
+    if (!terminal_pool_source) {
+        terminal_pool_source = g_idle_add_full(G_PRIORITY_LOW, refill_terminal_pool, NULL, NULL);
+    }
+}
+
+static TerminalData* take_pooled_terminal(const gchar *cwd, gchar **argv, Environment *environment) {
+    // Take the oldest ready terminal and prepare a replacement in the background
+    TerminalData *data = g_queue_pop_head(&terminal_pool);
+    schedule_terminal_pool_refill();
+
+    if (!data) {
+        return NULL;
+    }
+
+    // Its shell serves a tab asking for the same one, as it is
+    if (data->environment == environment && is_shell_argv(argv, environment) && g_strcmp0(data->cwd, cwd) == 0) {
+        g_strfreev(argv);
+        unref_environment(environment);
+        return data;
+    }
+
+    // Any other tab hangs that shell up, and gets its child spawned on fresh PTYs
+    if (data->environment) {
+        close_terminal_ptys(data);
+        data->child_pid = 0;
+        unref_environment(data->environment);
+        g_strfreev(data->argv);
+    }
+
+    // It stands in for any tab, taking over its spawn parameters like new_terminal_data
+    g_free(data->cwd);
+    data->cwd = g_strdup(cwd);
+    data->argv = argv;
+    data->environment = environment;
+    data->login_shell = is_shell_argv(argv, environment);
+
+    return data;
+}
+
+static void remember_pool_shell(const gchar *cwd, Environment *environment) {
+    // Later pooled terminals start their shell for this directory and environment
+    if (terminal_pool_environment != environment) {
+        if (terminal_pool_environment) {
+            unref_environment(terminal_pool_environment);
+        }
+        terminal_pool_environment = ref_environment(environment);
+    }
+    if (g_strcmp0(terminal_pool_cwd, cwd) != 0) {
+        g_free(terminal_pool_cwd);
+        terminal_pool_cwd = g_strdup(cwd);
+    }
+}
+
+static TerminalData* open_terminal_tab(WindowData *window_data, const gchar *cwd, gchar **argv, Environment *environment) {
+    // The next tab with the shell is likely to ask for the same directory and environment
+    if (is_shell_argv(argv, environment)) {
+        remember_pool_shell(cwd, environment);
+    }
+
+    // Use a pooled terminal if one is ready, else create the tab from scratch
+    TerminalData *data = take_pooled_terminal(cwd, argv, environment);
+
+    if (data) {
+        // Hand the ready terminal over to the notebook
+        attach_terminal_tab(window_data, data);
+        g_object_unref(data->page);
+    } else {
+        data = create_terminal_tab(window_data, cwd, argv, environment);
+    }
+
+    // Spawn the child right away
+    instantiate_terminal(data);
+
+    return data;
+}
+
+static void open_new_tab(WindowData *window_data, TerminalData *current) {
+    // Open the new tab in the current tab's directory with the same environment, running the shell
+    gchar *cwd = get_terminal_cwd(current);
+    TerminalData *data = open_terminal_tab(window_data, cwd, get_shell_argv(current->environment), ref_environment(current->environment));
+    g_free(cwd);
+
+    // Show the new tab
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    gtk_notebook_set_current_page(notebook, gtk_notebook_page_num(notebook, data->page));
+}
+
+// Window construction, defined together with the menus below
+static WindowData* create_terminal_window();
+
+static void hold_application_for_window(GtkWidget *window) {
+    // Keep the application alive until the window is closed
+    GApplication *application = g_application_get_default();
+
+    g_application_hold(application);
+    g_signal_connect_swapped(window, "destroy", G_CALLBACK(g_application_release), application);
+}
+
+void on_new_window_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *current_window = user_data;
+
+    // Create the window, which lives on its own rather than with a command line, and keeps its terminals when
+    // closed like the current one
+    WindowData *window_data = create_terminal_window();
+    window_data->detach = current_window->detach;
+    hold_application_for_window(window_data->window);
+
+    // Open its first tab like a new tab of the current window
+    open_new_tab(window_data, get_current_tab(current_window));
+}
+
+void on_new_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+
+    // Open a new tab next to the current one
+    open_new_tab(window_data, get_current_tab(window_data));
+}
+
+void on_close_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Close the current tab, and the window with it if it was the last one
+    close_terminal_tab(get_current_tab(user_data), 0);
+}
+
+static void replace_pane_widget(GtkWidget *old, GtkWidget *new) {
+    GtkWidget *parent = gtk_widget_get_parent(old);
+
+    gboolean first = GTK_IS_PANED(parent) && gtk_paned_get_child1(GTK_PANED(parent)) == old;
+
+    // Put the new widget where the old one was, either half of a split or the whole page; the caller keeps the old one
+    g_object_ref(old);
+    gtk_container_remove(GTK_CONTAINER(parent), old);
+    if (!GTK_IS_PANED(parent)) {
+        gtk_box_pack_start(GTK_BOX(parent), new, TRUE, TRUE, 0);
+    } else if (first) {
+        gtk_paned_pack1(GTK_PANED(parent), new, TRUE, FALSE);
+    } else {
+        gtk_paned_pack2(GTK_PANED(parent), new, TRUE, FALSE);
+    }
+}
+
+static void pane_destroyed(GtkWidget *page, gpointer user_data) {
+    TerminalData *data = user_data;
+    TerminalData *tab = data->tab;
+
+    // The tab forgets the pane, and gives the focus back to its own terminal if the pane had it
+    tab->panes = g_list_remove(tab->panes, data);
+    if (tab->active_pane == data) {
+        tab->active_pane = NULL;
+        update_tab_title(tab);
+    }
+}
+
+static void focus_first_terminal(GtkWidget *widget) {
+    // A split part is either a paned of more parts or the box of a single pane
+    if (GTK_IS_PANED(widget)) {
+        focus_first_terminal(gtk_paned_get_child1(GTK_PANED(widget)));
+    } else {
+        GList *children = gtk_container_get_children(GTK_CONTAINER(widget));
+
+        if (children) {
+            gtk_widget_grab_focus(children->data);
+        }
+        g_list_free(children);
+    }
+}
+
+static void split_pane(WindowData *window_data, GtkOrientation orientation) {
+    TerminalData *tab = get_current_tab(window_data);
+    TerminalData *current = get_current_pane(window_data);
+
+    if (!current || !current->terminal) {
+        return;
+    }
+
+    // Splitting the tab the first time moves its terminal from the page into a pane box of its own
+    if (tab->pane == tab->page) {
+        GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+        GList *children = gtk_container_get_children(GTK_CONTAINER(tab->page));
+
+        for (GList *child = children; child; child = child->next) {
+            g_object_ref(child->data);
+            gtk_container_remove(GTK_CONTAINER(tab->page), child->data);
+            gtk_box_pack_start(GTK_BOX(box), child->data, child == children, child == children, 0);
+            g_object_unref(child->data);
+        }
+        g_list_free(children);
+
+        gtk_box_pack_start(GTK_BOX(tab->page), box, TRUE, TRUE, 0);
+        gtk_widget_show(box);
+        tab->pane = box;
+    }
+
+    // The new pane runs the shell in the current pane's directory with the tab's environment
+    gchar *cwd = get_terminal_cwd(current);
+    TerminalData *pane = new_terminal_data(cwd, get_shell_argv(tab->environment), ref_environment(tab->environment));
+    g_free(cwd);
+    pane->tab = tab;
+    pane->window = tab->window;
+    tab->panes = g_list_append(tab->panes, pane);
+    g_signal_connect(pane->page, "destroy", G_CALLBACK(pane_destroyed), pane);
+
+    // Split the current pane in two halves, which keep their share of the space when the tab is resized
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(current->pane, &allocation);
+    GtkWidget *paned = gtk_paned_new(orientation);
+    replace_pane_widget(current->pane, paned);
+    gtk_paned_pack1(GTK_PANED(paned), current->pane, TRUE, FALSE);
+    g_object_unref(current->pane);
+    gtk_paned_pack2(GTK_PANED(paned), pane->page, TRUE, FALSE);
+    gtk_paned_set_position(GTK_PANED(paned), (orientation == GTK_ORIENTATION_HORIZONTAL ? allocation.width : allocation.height) / 2);
+    gtk_widget_show(paned);
+    gtk_widget_show(pane->page);
+
+    // Start the pane's terminal at the current zoom and move to it
+    instantiate_terminal(pane);
+    vte_terminal_set_font_scale(pane->terminal, vte_terminal_get_font_scale(current->terminal));
+    gtk_widget_grab_focus(GTK_WIDGET(pane->terminal));
+}
+
+static void close_pane(TerminalData *data) {
+    GtkWidget *paned = gtk_widget_get_parent(data->pane);
+    GtkWidget *sibling = gtk_paned_get_child1(GTK_PANED(paned)) == data->pane ?
+        gtk_paned_get_child2(GTK_PANED(paned)) :
+        gtk_paned_get_child1(GTK_PANED(paned));
+
+    // The other half takes the place of the split, and the pane goes with the paned
+    g_object_ref(sibling);
+    gtk_container_remove(GTK_CONTAINER(paned), sibling);
+    replace_pane_widget(paned, sibling);
+    g_object_unref(sibling);
+    gtk_widget_destroy(paned);
+    g_object_unref(paned);
+
+    focus_first_terminal(sibling);
+}
+
+void on_split_right_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Open a new pane to the right of the current one
+    split_pane(user_data, GTK_ORIENTATION_HORIZONTAL);
+}
+
+void on_split_down_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Open a new pane below the current one
+    split_pane(user_data, GTK_ORIENTATION_VERTICAL);
+}
+
+void on_broadcast_input_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    TerminalData *data = get_current_pane(user_data);
+
+    // Add the focused pane to the broadcast group, or take it out
+    if (data && data->terminal) {
+        set_terminal_broadcasting(data, !data->broadcasting);
+    }
+}
+
+void on_broadcast_window_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    TerminalData *current = get_current_pane(window_data);
+
+    if (!current) {
+        return;
+    }
+
+    // Put every started terminal of the window in the group, or take them all out if the focused one is in it
+    gboolean broadcasting = !current->broadcasting;
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+        TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+
+        if (data->terminal) {
+            set_terminal_broadcasting(data, broadcasting);
+        }
+        for (GList *pane = data->panes; pane; pane = pane->next) {
+            set_terminal_broadcasting(pane->data, broadcasting);
+        }
+    }
+}
+
+void on_close_window_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // This function is a callback for the "Close Window" menu item.
+    // It is triggered when the menu item is activated.
+    WindowData *window_data = user_data;
+
+    // Close the window like its close button does, asking for confirmation first
+    gtk_window_close(GTK_WINDOW(window_data->window));
+}
+
+static void detach_terminal_tab(WindowData *window_data, TerminalData *data) {
+    // Take the page out of the notebook, keeping it, the terminal and the child alive
+    g_object_ref(data->page);
+    gtk_container_remove(GTK_CONTAINER(window_data->notebook), data->page);
+    data->window = NULL;
+    data->label = NULL;
+    for (GList *pane = data->panes; pane; pane = pane->next) {
+        ((TerminalData *) pane->data)->window = NULL;
+    }
+
+    // It is no longer one of the session's tabs, and attaching it again records it anew
+    record_session_closed('C', data->id);
+    g_signal_handlers_disconnect_by_func(data->page, session_tab_closed, data);
+
+    // Keep running for as long as a terminal waits to be attached
+    detached_terminals = g_list_append(detached_terminals, data);
+    g_application_hold(g_application_get_default());
+}
+
+static void detach_window_tabs(WindowData *window_data) {
+    GList *pages = gtk_container_get_children(GTK_CONTAINER(window_data->notebook));
+
+    // The find bar goes away with the window
+    cancel_search(window_data);
+
+    // Tabs never shown have no child to keep, they close with the window
+    window_data->detaching = TRUE;
+    for (GList *item = pages; item; item = item->next) {
+        TerminalData *data = g_object_get_data(G_OBJECT(item->data), "terminal-data");
+
+        if (data->terminal) {
+            detach_terminal_tab(window_data, data);
+        }
+    }
+    g_list_free(pages);
+
+    // The command line that opened the window is done with it
+    set_exit_status(g_object_steal_data(G_OBJECT(window_data->window), "cli"), EXIT_SUCCESS);
+}
+
+static TerminalData* find_detached_terminal(guint id) {
+    for (GList *item = detached_terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+
+        if (data->id == id) {
+            return data;
+        }
+    }
+
+    return NULL;
+}
+
+static void print_detached_terminals(GApplicationCommandLine *cli) {
+    // One line per terminal, its number and its title
+    for (GList *item = detached_terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+        g_application_command_line_print(cli, "%u\t%s\n", data->id, get_tab_title(data));
+    }
+}
+
+static void reattach_terminal_tab(WindowData *window_data, TerminalData *data) {
+    // Hand the running terminal over to the notebook, as is, scrollback and all
+    detached_terminals = g_list_remove(detached_terminals, data);
+    attach_terminal_tab(window_data, data);
+    g_object_unref(data->page);
+    for (GList *pane = data->panes; pane; pane = pane->next) {
+        ((TerminalData *) pane->data)->window = window_data->window;
+    }
+    update_tab_title(data);
+
+    // The window holds the application now
+    g_application_release(g_application_get_default());
+}
+
+// Formats scrollback is saved in, by the names used on the command line and over D-Bus
+typedef enum {
+    EXPORT_TEXT,
+    EXPORT_ANSI,
+    EXPORT_HTML,
+} ExportFormat;
+
+static const gchar *const export_format_names[] = { "text", "ansi", "html" };
+
+// Rows read from the terminal per main loop iteration of an export, most slices waiting for the writer at once,
+// and bytes of spilled rows the writer reads at a time
+#define EXPORT_SLICE_ROWS 256
+#define EXPORT_QUEUE_SLICES 4
+#define EXPORT_SPILL_CHUNK_SIZE 65536
+
+// Called on the main loop once an export is written, or failed
+typedef void (*ExportCallback)(GError *error, gpointer user_data);
+
+// Rows on their way to the writer thread, with the attributes of each byte of the text, or NULL for plain text
+typedef struct {
+    gchar *text;
+    GArray *attributes;
+} ExportSlice;
+
+// A scrollback export: the main loop reads the rows from the terminal a slice at a time, and a writer thread
+// formats, compresses and writes them, never more than EXPORT_QUEUE_SLICES behind, so memory stays bounded
+typedef struct {
+    // The terminal exported, NULL once it went away, and the rows still to read from it
+    VteTerminal *terminal;
+    gulong destroy_handler;
+    glong next_row;
+    glong end_row;
+
+    // Format, and the file written to, compressed or not
+    ExportFormat format;
+    gzFile file;
+
+    // The terminal's spill file opened for reading, or NULL, how much of it was written when the export began,
+    // the rows read from VTE before and after it, and whether it has yet to be queued for the writer
+    gzFile spill;
+    gsize spill_length;
+    glong spill_row;
+    glong spill_end_row;
+    gboolean spill_pending;
+
+    // Slices for the writer, how many of them it has not finished yet, and whether the last one was queued
+    GAsyncQueue *queue;
+    gint queued;
+    gboolean queued_all;
+
+    // Idle source reading the next slice, 0 while the writer catches up
+    guint source;
+
+    // Set on the main loop when the terminal closed early, and by the writer when writing failed
+    gboolean truncated;
+    GError *error;
+
+    ExportCallback callback;
+    gpointer user_data;
+} ScrollbackExport;
+
+// Queued after the last slice of an export, and where the rows of the spill file go
+static ExportSlice export_queue_end;
+static ExportSlice export_queue_spill;
+
+static gboolean parse_export_format(const gchar *name, ExportFormat *format) {
+    // Plain text unless told otherwise
+    *format = EXPORT_TEXT;
+    if (!name || !*name) {
+        return TRUE;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(export_format_names); ++i) {
+        if (g_strcmp0(name, export_format_names[i]) == 0) {
+            *format = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void clear_scrollback_export(gpointer user_data) {
+    ScrollbackExport *export = user_data;
+
+    g_async_queue_unref(export->queue);
+    if (export->error) {
+        g_error_free(export->error);
+    }
+}
+
+static void append_export_style(GString *out, ExportFormat format, const VteCharAttributes *attributes) {
+    // Colors are 16 bits per channel, the formats take 8
+    const GdkColor *fore = &attributes->fore;
+    const GdkColor *back = &attributes->back;
+
+    if (format == EXPORT_ANSI) {
+        g_string_append_printf(out, "\033[0;38;2;%u;%u;%u;48;2;%u;%u;%u%s%sm",
+                               fore->red >> 8, fore->green >> 8, fore->blue >> 8,
+                               back->red >> 8, back->green >> 8, back->blue >> 8,
+                               attributes->underline ? ";4" : "", attributes->strikethrough ? ";9" : "");
+    } else {
+        g_string_append_printf(out, "<span style=\"color:#%02x%02x%02x;background-color:#%02x%02x%02x%s%s%s\">",
+                               fore->red >> 8, fore->green >> 8, fore->blue >> 8,
+                               back->red >> 8, back->green >> 8, back->blue >> 8,
+                               attributes->underline || attributes->strikethrough ? ";text-decoration:" : "",
+                               attributes->underline ? " underline" : "", attributes->strikethrough ? " line-through" : "");
+    }
+}
+
+static gboolean is_same_export_style(const VteCharAttributes *a, const VteCharAttributes *b) {
+    return a->fore.red == b->fore.red && a->fore.green == b->fore.green && a->fore.blue == b->fore.blue &&
+           a->back.red == b->back.red && a->back.green == b->back.green && a->back.blue == b->back.blue &&
+           a->underline == b->underline && a->strikethrough == b->strikethrough;
+}
+
+static void format_export_slice(ExportFormat format, ExportSlice *slice, GString *out) {
+    gsize length = strlen(slice->text);
+
+    if (format == EXPORT_TEXT) {
+        g_string_append_len(out, slice->text, length);
+        return;
+    }
+
+    // The attributes come one per byte; a VTE that no longer reports them leaves the text unstyled
+    gboolean styled = slice->attributes && slice->attributes->len >= length;
+    const VteCharAttributes *style = NULL;
+
+    for (gsize i = 0; i < length; ++i) {
+        gchar c = slice->text[i];
+        const VteCharAttributes *attributes = styled ? &g_array_index(slice->attributes, VteCharAttributes, i) : NULL;
+
+        // Each line carries its own styles, so that it reads right when cut out of the file
+        if (style && (c == '\n' || !is_same_export_style(attributes, style))) {
+            g_string_append(out, format == EXPORT_ANSI ? "\033[0m" : "</span>");
+            style = NULL;
+        }
+        if (attributes && c != '\n' && !style) {
+            append_export_style(out, format, attributes);
+            style = attributes;
+        }
+
+        if (format == EXPORT_HTML && c == '&') {
+            g_string_append(out, "&amp;");
+        } else if (format == EXPORT_HTML && c == '<') {
+            g_string_append(out, "&lt;");
+        } else if (format == EXPORT_HTML && c == '>') {
+            g_string_append(out, "&gt;");
+        } else {
+            g_string_append_c(out, c);
+        }
+    }
+
+    if (style) {
+        g_string_append(out, format == EXPORT_ANSI ? "\033[0m" : "</span>");
+    }
+}
+
+static void write_export(ScrollbackExport *export, GString *out) {
+    // After the first failure the rest is only drained
+    if (!export->error && out->len > 0 && gzwrite(export->file, out->str, out->len) <= 0) {
+        gint code;
+        const gchar *message = gzerror(export->file, &code);
+
+        export->error = g_error_new(G_IO_ERROR, code == Z_ERRNO ? g_io_error_from_errno(errno) : G_IO_ERROR_FAILED,
+                                    "%s", code == Z_ERRNO ? g_strerror(errno) : message);
+    }
+    g_string_truncate(out, 0);
+}
+
+static void write_spilled_rows(ScrollbackExport *export, GString *out) {
+    ExportSlice spilled = { g_malloc(EXPORT_SPILL_CHUNK_SIZE + 1), NULL };
+
+    // The rows as the plain text they were spilled as, up to where the file had been flushed
+    for (gsize left = export->spill_length; left > 0 && !export->error;) {
+        gint count = gzread(export->spill, spilled.text, MIN(left, EXPORT_SPILL_CHUNK_SIZE));
+
+        if (count <= 0) {
+            export->error = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED, "Unable to read the scrollback spilled to disk");
+            break;
+        }
+        spilled.text[count] = '\0';
+        format_export_slice(export->format, &spilled, out);
+        write_export(export, out);
+        left -= count;
+    }
+
+    g_free(spilled.text);
+    gzclose(export->spill);
+    export->spill = NULL;
+}
+
+static gboolean resume_scrollback_export(gpointer user_data);
+static gboolean finish_scrollback_export(gpointer user_data);
+
+static gpointer run_export_writer(gpointer user_data) {
+    ScrollbackExport *export = user_data;
+    GString *out = g_string_new(NULL);
+    ExportSlice *slice;
+
+    if (export->format == EXPORT_HTML) {
+        g_string_append(out, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>Scrollback</title>\n</head>\n<body>\n<pre>");
+    }
+
+    // Format and write the slices in order, letting the main loop read more as each one is done
+    while ((slice = g_async_queue_pop(export->queue)) != &export_queue_end) {
+        if (slice == &export_queue_spill) {
+            write_spilled_rows(export, out);
+            g_atomic_int_add(&export->queued, -1);
+            continue;
+        }
+
+        format_export_slice(export->format, slice, out);
+        write_export(export, out);
+
+        g_free(slice->text);
+        if (slice->attributes) {
+            g_array_unref(slice->attributes);
+        }
+        g_free(slice);
+
+        g_atomic_int_add(&export->queued, -1);
+        g_idle_add(resume_scrollback_export, g_atomic_rc_box_acquire(export));
+    }
+
+    if (export->format == EXPORT_HTML) {
+        g_string_append(out, "</pre>\n</body>\n</html>\n");
+    }
+    write_export(export, out);
+    g_string_free(out, TRUE);
+
+    // The terminal may have closed before the spill file's turn came
+    if (export->spill) {
+        gzclose(export->spill);
+    }
+
+    // Closing flushes what the compressor still holds
+    if (gzclose(export->file) != Z_OK && !export->error) {
+        export->error = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED, "Unable to finish writing the file");
+    }
+
+    g_idle_add(finish_scrollback_export, export);
+    return NULL;
+}
+
+static void end_scrollback_export(ScrollbackExport *export) {
+    // Let the writer finish after the slices queued so far
+    if (export->source) {
+        g_source_remove(export->source);
+        export->source = 0;
+    }
+    if (!export->queued_all) {
+        export->queued_all = TRUE;
+        g_async_queue_push(export->queue, &export_queue_end);
+    }
+}
+
+static gboolean read_export_slice(gpointer user_data) {
+    ScrollbackExport *export = user_data;
+
+    if (!export->terminal || (export->next_row >= export->end_row && !export->spill_pending)) {
+        export->source = 0;
+        end_scrollback_export(export);
+        return G_SOURCE_REMOVE;
+    }
+
+    // Wait for the writer to catch up, it resumes reading when it finished a slice
+    if (g_atomic_int_get(&export->queued) >= EXPORT_QUEUE_SLICES) {
+        export->source = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    // Rows that left the scrollback while the export went on are lost, continue from the oldest one still held
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(export->terminal));
+    glong start = MAX(export->next_row, (glong) gtk_adjustment_get_lower(adjustment));
+
+    // The spilled rows go where they belong, and the copies VTE may still hold of them are skipped
+    if (export->spill_pending && start >= export->spill_row) {
+        export->spill_pending = FALSE;
+        export->next_row = MAX(start, export->spill_end_row);
+        g_atomic_int_inc(&export->queued);
+        g_async_queue_push(export->queue, &export_queue_spill);
+        return G_SOURCE_CONTINUE;
+    }
+
+    glong end = MIN(start + EXPORT_SLICE_ROWS, export->spill_pending ? export->spill_row : export->end_row);
+    if (start >= end) {
+        export->next_row = start;
+        return G_SOURCE_CONTINUE;
+    }
+
+    ExportSlice *slice = g_new0(ExportSlice, 1);
+    if (export->format != EXPORT_TEXT) {
+        slice->attributes = g_array_new(FALSE, FALSE, sizeof(VteCharAttributes));
+    }
+
+    // Styles are only to be had with the text through the attributes of vte_terminal_get_text_range
+    glong columns = vte_terminal_get_column_count(export->terminal);
+    if (slice->attributes) {
+        slice->text = vte_terminal_get_text_range(export->terminal, start, 0, end - 1, columns, NULL, NULL, slice->attributes);
+    } else {
+        slice->text = vte_terminal_get_text_range_format(export->terminal, VTE_FORMAT_TEXT, start, 0, end - 1, columns, NULL);
+    }
+    if (!slice->text) {
+        slice->text = g_strdup("");
+    }
+    export->next_row = end;
+
+    g_atomic_int_inc(&export->queued);
+    g_async_queue_push(export->queue, slice);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean resume_scrollback_export(gpointer user_data) {
+    ScrollbackExport *export = user_data;
+
+    // The writer finished a slice, read on unless reading already goes on or is over
+    if (!export->source && !export->queued_all) {
+        export->source = g_idle_add(read_export_slice, export);
+    }
+
+    g_atomic_rc_box_release_full(export, clear_scrollback_export);
+    return G_SOURCE_REMOVE;
+}
+
+static void export_terminal_destroyed(GtkWidget *widget, gpointer user_data) {
+    ScrollbackExport *export = user_data;
+
+    // Keep what was written, and report the file as incomplete unless every row had been read already
+    export->terminal = NULL;
+    export->truncated = !export->queued_all && export->next_row < export->end_row;
+    end_scrollback_export(export);
+}
+
+static gboolean finish_scrollback_export(gpointer user_data) {
+    ScrollbackExport *export = user_data;
+
+    if (export->terminal) {
+        g_signal_handler_disconnect(export->terminal, export->destroy_handler);
+    }
+    if (!export->error && export->truncated) {
+        export->error = g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED, "The terminal closed before its scrollback was saved");
+    }
+
+    export->callback(export->error, export->user_data);
+    g_application_release(g_application_get_default());
+
+    g_atomic_rc_box_release_full(export, clear_scrollback_export);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean export_scrollback(TerminalData *data, const gchar *path, ExportFormat format,
+                                  ExportCallback callback, gpointer user_data, GError **error) {
+    // Only a terminal that has been shown has scrollback
+    if (!data->terminal) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED, "The terminal has not been started yet");
+        return FALSE;
+    }
+
+    // A name ending in .gz is compressed, anything else written as is
+    gzFile file = gzopen(path, g_str_has_suffix(path, ".gz") ? "wb6" : "wbT");
+    if (!file) {
+        gint saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno), "Unable to open %s: %s", path, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    ScrollbackExport *export = g_atomic_rc_box_new0(ScrollbackExport);
+    export->terminal = data->terminal;
+    export->format = format;
+    export->file = file;
+    export->queue = g_async_queue_new();
+    export->callback = callback;
+    export->user_data = user_data;
+    export->destroy_handler = g_signal_connect(data->terminal, "destroy", G_CALLBACK(export_terminal_destroyed), export);
+
+    // Every row VTE holds at this point, the screen included
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(data->terminal));
+    export->next_row = (glong) gtk_adjustment_get_lower(adjustment);
+    export->end_row = (glong) gtk_adjustment_get_upper(adjustment);
+
+    // Preceded by the rows spilled to disk so far, flushed so that they can be read back, which VTE then does not
+    // have to provide again
+    if (data->spill_file && gzflush(data->spill_file, Z_SYNC_FLUSH) == Z_OK) {
+        export->spill = gzopen(data->spill_path, "rb");
+    }
+    if (export->spill) {
+        export->spill_length = data->spill_length;
+        export->spill_row = CLAMP(data->spill_first_row, export->next_row, export->end_row);
+        export->spill_end_row = data->spill_end_row;
+        export->spill_pending = TRUE;
+    }
+
+    // Keep running until the file is written, even if the last window closes meanwhile
+    g_application_hold(g_application_get_default());
+
+    // The writer owns the main loop's reference, handed back when it finishes
+    g_thread_unref(g_thread_new("export", run_export_writer, export));
+    export->source = g_idle_add(read_export_slice, export);
+
+    return TRUE;
+}
+
+static TerminalData* find_terminal(guint id) {
+    // Terminals by the number the stats interface reports them with
+    for (GList *item = terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+
+        if (data->id == id) {
+            return data;
+        }
+    }
+
+    return NULL;
+}
+
+static void save_scrollback_finished(GError *error, gpointer user_data) {
+    if (error) {
+        g_warning("Unable to save the scrollback: %s", error->message);
+    }
+}
+
+static void save_scrollback_response(GtkDialog *dialog, gint response, gpointer user_data) {
+    GtkFileChooser *chooser = GTK_FILE_CHOOSER(dialog);
+    TerminalData *data = find_terminal(GPOINTER_TO_UINT(user_data));
+
+    // The terminal may have closed while the dialog was open
+    if (response == GTK_RESPONSE_ACCEPT && data) {
+        gchar *filename = gtk_file_chooser_get_filename(chooser);
+        gboolean compress = g_strcmp0(gtk_file_chooser_get_choice(chooser, "compress"), "true") == 0;
+        gchar *path = compress && !g_str_has_suffix(filename, ".gz") ? g_strconcat(filename, ".gz", NULL) : g_strdup(filename);
+        ExportFormat format;
+        GError *error = NULL;
+
+        parse_export_format(gtk_file_chooser_get_choice(chooser, "format"), &format);
+        if (!export_scrollback(data, path, format, save_scrollback_finished, NULL, &error)) {
+            save_scrollback_finished(error, NULL);
+            g_error_free(error);
+        }
+
+        g_free(path);
+        g_free(filename);
+    }
+
+    gtk_widget_destroy(GTK_WIDGET(dialog));
+}
+
+void on_save_scrollback_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    TerminalData *data = get_current_pane(window_data);
+
+    if (!data) {
+        return;
+    }
+
+    // Ask for the file, the format and whether to compress it
+    GtkWidget *dialog = gtk_file_chooser_dialog_new("Save Scrollback", GTK_WINDOW(window_data->window), GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    "Cancel", GTK_RESPONSE_CANCEL, "Save", GTK_RESPONSE_ACCEPT, NULL);
+    GtkFileChooser *chooser = GTK_FILE_CHOOSER(dialog);
+    gtk_file_chooser_set_do_overwrite_confirmation(chooser, TRUE);
+    gtk_file_chooser_set_current_name(chooser, "scrollback.txt");
+    gtk_file_chooser_add_choice(chooser, "format", "Format", (const gchar *[]) { "text", "ansi", "html", NULL },
+                                (const gchar *[]) { "Plain text", "Text with colors (ANSI)", "HTML", NULL });
+    gtk_file_chooser_set_choice(chooser, "format", "text");
+    gtk_file_chooser_add_choice(chooser, "compress", "Compress (gzip)", NULL, NULL);
+
+    // Answered from the main loop rather than a nested one, the terminal is looked up again by its number then
+    gtk_window_set_destroy_with_parent(GTK_WINDOW(dialog), TRUE);
+    g_signal_connect(dialog, "response", G_CALLBACK(save_scrollback_response), GUINT_TO_POINTER(data->id));
+    gtk_widget_show(dialog);
+}
+
+void on_log_output_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    TerminalData *data = get_current_pane(user_data);
+
+    // Start logging the focused pane, or stop it
+    if (data && data->pty) {
+        if (data->log) {
+            stop_session_log(data);
+        } else {
+            start_session_log(data);
+        }
+    }
+}
+
+static void fill_file_menu(GtkWidget *file_menu, WindowData *window_data) {
+    GtkWidget *new_window = create_action_menu_item("New Window", "new-window", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), new_window);
+    
+    GtkWidget *new_tab = create_action_menu_item("New Tab", "new-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), new_tab);
+    
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), gtk_separator_menu_item_new());
+    
+    GtkWidget *save_scrollback = create_action_menu_item("Save Scrollback As...", "save-scrollback", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), save_scrollback);
+
+    GtkWidget *log_output = create_action_menu_item("Log Output", "log-output", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), log_output);
+    
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), gtk_separator_menu_item_new());
+    
+    GtkWidget *close_tab = create_action_menu_item("Close Tab", "close-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), close_tab);
+    
+    GtkWidget *close_window = create_action_menu_item("Close Window", "close-window", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), close_window);
+}
+
+static VteTerminal* get_current_terminal(WindowData *window_data) {
+    // The terminal of the shown tab's focused pane, which exists since showing a tab instantiates it
+    TerminalData *data = get_current_pane(window_data);
+
+    return data ? data->terminal : NULL;
+}
+
+static void on_copy_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    VteTerminal *terminal = get_current_terminal(user_data);
+
+    if (terminal) {
+        vte_terminal_copy_clipboard_format(terminal, VTE_FORMAT_TEXT);
+    }
+}
+
+static void on_paste_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    TerminalData *data = get_current_pane(user_data);
+
+    if (data) {
+        start_paste(data);
+    }
+}
+
+static void on_clear_scrollback_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    TerminalData *data = get_current_pane(user_data);
+
+    // Dropping the scrollback ring and restoring its size clears the history but keeps the screen
+    if (data && data->terminal) {
+        vte_terminal_set_scrollback_lines(data->terminal, 0);
+        vte_terminal_set_scrollback_lines(data->terminal, data->scrollback_lines);
+    }
+}
+
+static void on_zoom_in_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    VteTerminal *terminal = get_current_terminal(window_data);
+
+    if (terminal) {
+        increase_font_size(GTK_WIDGET(terminal), window_data->window);
+    }
+}
+
+static void on_zoom_out_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    VteTerminal *terminal = get_current_terminal(window_data);
+
+    if (terminal) {
+        decrease_font_size(GTK_WIDGET(terminal), window_data->window);
+    }
+}
+
+static void on_preferences_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    gchar *path = get_config_path();
+    gchar *directory = g_path_get_dirname(path);
+    GError *error = NULL;
+
+    // Open the configuration file in the user's editor, creating an empty one first; saving it applies it
+    if (!g_file_test(path, G_FILE_TEST_EXISTS) &&
+        (g_mkdir_with_parents(directory, 0700) < 0 || !g_file_set_contents(path, "[terminal]\n", -1, &error))) {
+        if (!error) {
+            g_set_error(&error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno));
+        }
+    } else {
+        gchar *uri = g_filename_to_uri(path, NULL, &error);
+
+        if (uri) {
+            gtk_show_uri_on_window(GTK_WINDOW(window_data->window), uri, GDK_CURRENT_TIME, &error);
+            g_free(uri);
+        }
+    }
+
+    if (error) {
+        g_warning("Unable to open %s: %s", path, error->message);
+        g_error_free(error);
+    }
+
+    g_free(directory);
+    g_free(path);
+}
+
+static void on_zoom_reset_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    VteTerminal *terminal = get_current_terminal(window_data);
+
+    if (terminal) {
+        reset_font_size(GTK_WIDGET(terminal), GTK_WINDOW(window_data->window));
+        reset_window_size(GTK_WIDGET(terminal), GTK_WINDOW(window_data->window));
+    }
+}
+
+// Rows snapshotted into one search chunk; chunk n holds the rows from n * SEARCH_CHUNK_ROWS on
+#define SEARCH_CHUNK_ROWS 1024
+
+// Bits trigrams are hashed to while a chunk is snapshotted, and bits of its filter per distinct trigram in it;
+// the filter is folded down to the smallest power of two giving each that many, so that a chunk with few
+// distinct trigrams gets a small filter and one with many does not end up with every bit set
+#define SEARCH_TRIGRAM_HASH_BITS 20
+#define SEARCH_TRIGRAM_DENSITY 8
+
+// Longest a main loop iteration spends snapshotting chunks for a search, in microseconds
+#define SEARCH_SLICE_TIME 4000
+
+// Snapshot of scrollback rows as text, one line per row; immutable once made, so search workers share it
+typedef struct {
+    // Absolute row of the first line
+    glong first_row;
+
+    // The rows, each followed by a newline
+    gchar *text;
+    gsize length;
+
+    // Bit set for every trigram of the text, ASCII letters lowered, at its hash (see get_search_trigram) masked
+    // with trigram_mask
+    guint trigram_mask;
+    guint64 trigrams[];
+} SearchChunk;
+
+// A chunk of a search index, and the rows matching the cached query in it, or NULL if not searched yet
+typedef struct {
+    gint64 number;
+    SearchChunk *chunk;
+    GArray *matches;
+} IndexedChunk;
+
+// Snapshots of the finished scrollback rows of a terminal, taken as they are first searched and kept for the
+// following searches, which only snapshot rows added since; the screen is snapshotted again every time
+struct _SearchIndex {
+    TerminalData *data;
+
+    // IndexedChunk by chunk number
+    GHashTable *chunks;
+
+    // Column count the chunks were taken at, a reflow changes the rows
+    glong columns;
+
+    // End of the rows covered by chunks
+    glong end_row;
+
+    // Query the matches of the chunks are for
+    gchar *cached_key;
+};
+
+// A search of one terminal: its chunks are matched by a worker thread, newest first, the results shown as they arrive
+struct _SearchJob {
+    // Window showing the search and the index searched, NULL once cancelled
+    WindowData *window_data;
+    SearchIndex *index;
+
+    // Query, the compiled pattern, and with a plain text query the trigram filter bits it needs
+    gchar *key;
+    GRegex *regex;
+    GArray *trigrams;
+
+    // Cancellation of the chunks still waiting for the worker
+    GCancellable *cancellable;
+
+    // Idle source queuing the chunks from next_chunk down, and results still to come back
+    guint source;
+    gint64 next_chunk;
+    guint pending;
+
+    // Rows with a match so far, whether they are sorted, and the row of the match shown, or -1
+    GArray *rows;
+    gboolean sorted;
+    glong current_row;
+};
+
+// A chunk on its way to the worker and back with its matching rows; rows given up front are the cached matches
+typedef struct {
+    SearchJob *job;
+    gint64 number;
+    SearchChunk *chunk;
+    GArray *rows;
+} SearchResult;
+
+// Thread matching the chunks of every search in the order they are queued (SearchResult)
+static GThreadPool *search_worker;
+
+static guint get_search_trigram(const guchar *bytes) {
+    // Hash three bytes, ignoring the case of ASCII letters like a case-insensitive match does
+    guint32 trigram = g_ascii_tolower(bytes[0]) << 16 | g_ascii_tolower(bytes[1]) << 8 | g_ascii_tolower(bytes[2]);
+
+    return (guint32) (trigram * 2654435761u) >> (32 - SEARCH_TRIGRAM_HASH_BITS);
+}
+
+static void clear_search_chunk(gpointer user_data) {
+    SearchChunk *chunk = user_data;
+
+    g_free(chunk->text);
+}
+
+static SearchChunk* snapshot_search_chunk(VteTerminal *terminal, glong start, glong end) {
+    // Only ever used from the main loop
+    static guint64 hashed[(1 << SEARCH_TRIGRAM_HASH_BITS) / 64];
+    GString *text = g_string_new(NULL);
+    glong columns = vte_terminal_get_column_count(terminal);
+
+    // One line per row, so that the row of a match is its line; a match across a wrapped row is not found
+    for (glong row = start; row < end; ++row) {
+        gsize length = 0;
+        gchar *line = vte_terminal_get_text_range_format(terminal, VTE_FORMAT_TEXT, row, 0, row, columns, &length);
+
+        while (length > 0 && line[length - 1] == '\n') {
+            --length;
+        }
+        g_string_append_len(text, line, length);
+        g_string_append_c(text, '\n');
+        g_free(line);
+    }
+
+    // Hash the trigrams, counting the distinct ones
+    gsize distinct = 0;
+    for (gsize i = 0; i + 2 < text->len; ++i) {
+        guint bit = get_search_trigram((const guchar *) text->str + i);
+        guint64 mask = G_GUINT64_CONSTANT(1) << (bit % 64);
+
+        distinct += !(hashed[bit / 64] & mask);
+        hashed[bit / 64] |= mask;
+    }
+
+    // Fold them into a filter sized for that many
+    gsize bits = 64;
+    while (bits < distinct * SEARCH_TRIGRAM_DENSITY && bits < (1 << SEARCH_TRIGRAM_HASH_BITS)) {
+        bits *= 2;
+    }
+    SearchChunk *chunk = g_atomic_rc_box_alloc0(sizeof(SearchChunk) + bits / 8);
+    chunk->trigram_mask = bits - 1;
+    for (gsize i = 0; distinct && i < G_N_ELEMENTS(hashed); ++i) {
+        chunk->trigrams[i % (bits / 64)] |= hashed[i];
+        hashed[i] = 0;
+    }
+
+    chunk->first_row = start;
+    chunk->length = text->len;
+    chunk->text = g_string_free(text, FALSE);
+    return chunk;
+}
+
+static void free_indexed_chunk(gpointer user_data) {
+    IndexedChunk *entry = user_data;
+
+    g_atomic_rc_box_release_full(entry->chunk, clear_search_chunk);
+    if (entry->matches) {
+        g_array_unref(entry->matches);
+    }
+    g_free(entry);
+}
+
+static void clear_search_job(gpointer user_data) {
+    SearchJob *job = user_data;
+
+    g_free(job->key);
+    g_regex_unref(job->regex);
+    if (job->trigrams) {
+        g_array_unref(job->trigrams);
+    }
+    g_object_unref(job->cancellable);
+    g_array_unref(job->rows);
+}
+
+static GArray* match_search_chunk(SearchJob *job, SearchChunk *chunk) {
+    GArray *rows = g_array_new(FALSE, FALSE, sizeof(glong));
+
+    // A chunk lacking one of the trigrams of a plain query cannot contain it
+    for (guint i = 0; job->trigrams && i < job->trigrams->len; ++i) {
+        guint bit = g_array_index(job->trigrams, guint, i) & chunk->trigram_mask;
+
+        if (!(chunk->trigrams[bit / 64] & (G_GUINT64_CONSTANT(1) << (bit % 64)))) {
+            return rows;
+        }
+    }
+
+    // Record each row with a match once, counting the lines up to each match from the previous one
+    GMatchInfo *match_info = NULL;
+    const gchar *line = chunk->text;
+    glong row = chunk->first_row;
+
+    g_regex_match_full(job->regex, chunk->text, chunk->length, 0, 0, &match_info, NULL);
+    while (g_match_info_matches(match_info) && !g_cancellable_is_cancelled(job->cancellable)) {
+        gint start;
+        g_match_info_fetch_pos(match_info, 0, &start, NULL);
+
+        for (const gchar *newline; (newline = memchr(line, '\n', chunk->text + start - line)); line = newline + 1) {
+            ++row;
+        }
+        if (rows->len == 0 || g_array_index(rows, glong, rows->len - 1) != row) {
+            g_array_append_val(rows, row);
+        }
+
+        g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+
+    return rows;
+}
+
+static void get_search_range(VteTerminal *terminal, glong *lower, glong *upper) {
+    // The vertical adjustment spans every row VTE still holds, in absolute row numbers
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+
+    *lower = (glong) gtk_adjustment_get_lower(adjustment);
+    *upper = (glong) gtk_adjustment_get_upper(adjustment);
+}
+
+static void update_search_status(SearchJob *job) {
+    gchar *status;
+
+    if (job->rows->len == 0) {
+        status = g_strdup(job->source || job->pending ? "Searching" : "No matches");
+    } else {
+        status = g_strdup_printf(job->source || job->pending ? "%u lines so far" : "%u lines", job->rows->len);
+    }
+
+    gtk_label_set_text(GTK_LABEL(job->window_data->find_status), status);
+    g_free(status);
+}
+
+static void show_search_match(SearchJob *job, glong row) {
+    VteTerminal *terminal = job->index->data->terminal;
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+
+    // Scroll the row to the top and have VTE select the match from there, highlighting it
+    job->current_row = row;
+    gtk_adjustment_set_value(adjustment, row);
+    vte_terminal_unselect_all(terminal);
+    vte_terminal_search_find_next(terminal);
+}
+
+static void add_search_rows(SearchJob *job, GArray *rows) {
+    glong lower, upper;
+
+    get_search_range(job->index->data->terminal, &lower, &upper);
+
+    // Rows dropped from the scrollback since the chunk was snapshotted cannot be shown any more
+    glong newest = -1;
+    for (guint i = 0; i < rows->len; ++i) {
+        glong row = g_array_index(rows, glong, i);
+
+        if (row >= lower && row < upper) {
+            g_array_append_val(job->rows, row);
+            job->sorted = FALSE;
+            newest = row;
+        }
+    }
+
+    // Chunks come newest first, so the first one with a match holds the most recent match, at its end
+    if (job->current_row < 0 && newest >= 0) {
+        show_search_match(job, newest);
+    }
+}
+
+static gboolean apply_search_result(gpointer user_data) {
+    SearchResult *result = user_data;
+    SearchJob *job = result->job;
+
+    // Results of a cancelled search are dropped
+    if (job->index && result->rows) {
+        IndexedChunk *entry = result->number >= 0 ? g_hash_table_lookup(job->index->chunks, &result->number) : NULL;
+
+        // Keep the matches for the next search with the same query
+        if (entry && entry->chunk == result->chunk && !entry->matches) {
+            entry->matches = g_array_ref(result->rows);
+        }
+
+        job->pending--;
+        add_search_rows(job, result->rows);
+        update_search_status(job);
+    }
+
+    g_atomic_rc_box_release_full(result->chunk, clear_search_chunk);
+    if (result->rows) {
+        g_array_unref(result->rows);
+    }
+    g_atomic_rc_box_release_full(job, clear_search_job);
+    g_free(result);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void run_search_worker(gpointer user_data, gpointer pool_data) {
+    SearchResult *result = user_data;
+
+    // Match a chunk unless its search was cancelled meanwhile, and hand the result back to the main loop
+    if (!result->rows && !g_cancellable_is_cancelled(result->job->cancellable)) {
+        result->rows = match_search_chunk(result->job, result->chunk);
+    }
+    g_idle_add(apply_search_result, result);
+}
+
+static void queue_search_chunk(SearchJob *job, gint64 number, SearchChunk *chunk, GArray *matches) {
+    SearchResult *result = g_new0(SearchResult, 1);
+
+    result->job = g_atomic_rc_box_acquire(job);
+    result->number = number;
+    result->chunk = g_atomic_rc_box_acquire(chunk);
+    result->rows = matches ? g_array_ref(matches) : NULL;
+
+    // One worker shared by all searches, started with the first; a search queued behind a cancelled one only
+    // waits for the chunk being matched, the others are skipped
+    if (!search_worker) {
+        search_worker = g_thread_pool_new(run_search_worker, NULL, 1, FALSE, NULL);
+    }
+
+    job->pending++;
+    g_thread_pool_push(search_worker, result, NULL);
+}
+
+static gboolean queue_search_chunks(gpointer user_data) {
+    SearchJob *job = user_data;
+    SearchIndex *index = job->index;
+    gint64 deadline = g_get_monotonic_time() + SEARCH_SLICE_TIME;
+    glong lower, upper;
+
+    get_search_range(index->data->terminal, &lower, &upper);
+
+    // Walk back through the chunks still holding rows, snapshotting the ones no search has needed before
+    while ((job->next_chunk + 1) * SEARCH_CHUNK_ROWS > lower && job->next_chunk >= 0) {
+        IndexedChunk *entry = g_hash_table_lookup(index->chunks, &job->next_chunk);
+
+        if (!entry) {
+            glong start = job->next_chunk * SEARCH_CHUNK_ROWS;
+
+            entry = g_new0(IndexedChunk, 1);
+            entry->number = job->next_chunk;
+            entry->chunk = snapshot_search_chunk(index->data->terminal, MAX(start, lower), start + SEARCH_CHUNK_ROWS);
+            g_hash_table_insert(index->chunks, &entry->number, entry);
+            index->end_row = MAX(index->end_row, start + SEARCH_CHUNK_ROWS);
+        }
+
+        queue_search_chunk(job, entry->number, entry->chunk, entry->matches);
+        job->next_chunk--;
+
+        if (g_get_monotonic_time() >= deadline) {
+            return G_SOURCE_CONTINUE;
+        }
+    }
+
+    job->source = 0;
+    update_search_status(job);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void cancel_search(WindowData *window_data) {
+    SearchJob *job = window_data->search_job;
+
+    if (!job) {
+        return;
+    }
+
+    // Stop queuing chunks, and have the worker skip the ones queued
+    window_data->search_job = NULL;
+    job->index = NULL;
+    g_cancellable_cancel(job->cancellable);
+    if (job->source) {
+        g_source_remove(job->source);
+        job->source = 0;
+    }
+    g_atomic_rc_box_release_full(job, clear_search_job);
+}
+
+static void free_search_index(GtkWidget *widget, gpointer user_data) {
+    TerminalData *data = user_data;
+    WindowData *window_data = data->window ? get_window_data(data->window) : NULL;
+
+    // A search of the terminal ends with it
+    if (window_data && window_data->search_job && window_data->search_job->index == data->search_index) {
+        cancel_search(window_data);
+    }
+
+    g_hash_table_destroy(data->search_index->chunks);
+    g_free(data->search_index->cached_key);
+    g_clear_pointer(&data->search_index, g_free);
+}
+
+static SearchIndex* get_search_index(TerminalData *data) {
+    SearchIndex *index = data->search_index;
+
+    // Created for the first search of the terminal, and kept until it goes away
+    if (!index) {
+        index = data->search_index = g_new0(SearchIndex, 1);
+        index->data = data;
+        index->chunks = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free_indexed_chunk);
+        g_signal_connect(data->terminal, "destroy", G_CALLBACK(free_search_index), data);
+    }
+
+    return index;
+}
+
+static gboolean drop_lost_chunk(gpointer key, gpointer value, gpointer user_data) {
+    IndexedChunk *entry = value;
+
+    return (entry->number + 1) * SEARCH_CHUNK_ROWS <= *(glong *) user_data;
+}
+
+static void forget_chunk_matches(gpointer key, gpointer value, gpointer user_data) {
+    IndexedChunk *entry = value;
+
+    g_clear_pointer(&entry->matches, g_array_unref);
+}
+
+static void update_search_index(SearchIndex *index, const gchar *key) {
+    VteTerminal *terminal = index->data->terminal;
+    glong columns = vte_terminal_get_column_count(terminal);
+    glong lower, upper;
+
+    get_search_range(terminal, &lower, &upper);
+
+    // A reflow rewrites every row, and after a reset the row numbers start over
+    if (columns != index->columns || upper < index->end_row) {
+        g_hash_table_remove_all(index->chunks);
+        index->columns = columns;
+        index->end_row = 0;
+    }
+
+    // Forget the chunks whose rows all left the scrollback
+    g_hash_table_foreach_remove(index->chunks, drop_lost_chunk, &lower);
+
+    // Matches are only kept for the last query
+    if (g_strcmp0(key, index->cached_key) != 0) {
+        g_hash_table_foreach(index->chunks, forget_chunk_matches, NULL);
+        g_free(index->cached_key);
+        index->cached_key = g_strdup(key);
+    }
+}
+
+static void start_search(WindowData *window_data) {
+    TerminalData *data = get_current_pane(window_data);
+    const gchar *text = gtk_entry_get_text(GTK_ENTRY(window_data->find_entry));
+    gboolean use_regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(window_data->find_regex));
+
+    cancel_search(window_data);
+    gtk_label_set_text(GTK_LABEL(window_data->find_status), "");
+    if (!data || !data->terminal || !*text) {
+        return;
+    }
+
+    // Plain text matches without regard to case, a regular expression as written
+    GError *error = NULL;
+    gchar *pattern = use_regex ? g_strdup(text) : g_regex_escape_string(text, -1);
+    GRegex *regex = g_regex_new(pattern, G_REGEX_MULTILINE | G_REGEX_OPTIMIZE | (use_regex ? 0 : G_REGEX_CASELESS), 0, &error);
+    VteRegex *vte_regex = regex ? vte_regex_new_for_search(pattern, -1, PCRE2_UTF | PCRE2_MULTILINE | (use_regex ? 0 : PCRE2_CASELESS), &error) : NULL;
+    g_free(pattern);
+
+    if (!vte_regex) {
+        gtk_label_set_text(GTK_LABEL(window_data->find_status), error->message);
+        g_error_free(error);
+        if (regex) {
+            g_regex_unref(regex);
+        }
+        return;
+    }
+
+    // VTE finds the match on the row shown, to select it
+    vte_terminal_search_set_regex(data->terminal, vte_regex, 0);
+    vte_regex_unref(vte_regex);
+
+    SearchJob *job = g_atomic_rc_box_new0(SearchJob);
+    job->window_data = window_data;
+    job->index = get_search_index(data);
+    job->key = g_strconcat(use_regex ? "regex:" : "text:", text, NULL);
+    job->regex = regex;
+    job->cancellable = g_cancellable_new();
+    job->rows = g_array_new(FALSE, FALSE, sizeof(glong));
+    job->current_row = -1;
+    window_data->search_job = job;
+
+    // The trigrams a plain query needs, leaving out those with bytes whose case is not ASCII
+    if (!use_regex) {
+        job->trigrams = g_array_new(FALSE, FALSE, sizeof(guint));
+        for (const guchar *bytes = (const guchar *) text; bytes[0] && bytes[1] && bytes[2]; ++bytes) {
+            if (bytes[0] < 0x80 && bytes[1] < 0x80 && bytes[2] < 0x80) {
+                guint bit = get_search_trigram(bytes);
+                g_array_append_val(job->trigrams, bit);
+            }
+        }
+    }
+
+    update_search_index(job->index, job->key);
+
+    // The screen and the rows above it not filling a chunk yet are searched first, from a fresh snapshot
+    glong lower, upper;
+    get_search_range(data->terminal, &lower, &upper);
+    glong history_end = MAX(upper - vte_terminal_get_row_count(data->terminal), 0);
+    gint64 newest_chunk = history_end / SEARCH_CHUNK_ROWS - 1;
+    SearchChunk *tail = snapshot_search_chunk(data->terminal, MAX((newest_chunk + 1) * SEARCH_CHUNK_ROWS, lower), upper);
+
+    queue_search_chunk(job, -1, tail, NULL);
+    g_atomic_rc_box_release_full(tail, clear_search_chunk);
+
+    // Then the finished chunks, newest first
+    job->next_chunk = newest_chunk;
+    job->source = g_idle_add(queue_search_chunks, job);
+
+    update_search_status(job);
+}
+
+static gint compare_search_rows(gconstpointer a, gconstpointer b) {
+    glong row_a = *(const glong *) a;
+    glong row_b = *(const glong *) b;
+
+    return row_a < row_b ? -1 : row_a > row_b;
+}
+
+static void move_search_match(WindowData *window_data, gboolean backward) {
+    SearchJob *job = window_data->search_job;
+
+    if (!job || job->rows->len == 0) {
+        return;
+    }
+
+    if (!job->sorted) {
+        g_array_sort(job->rows, compare_search_rows);
+        job->sorted = TRUE;
+    }
+
+    // The nearest match above or below the one shown, wrapping around at either end
+    guint count = job->rows->len;
+    glong target = g_array_index(job->rows, glong, backward ? count - 1 : 0);
+    for (guint i = 0; i < count; ++i) {
+        glong row = g_array_index(job->rows, glong, backward ? count - 1 - i : i);
+
+        if (backward ? row < job->current_row : row > job->current_row) {
+            target = row;
+            break;
+        }
+    }
+
+    show_search_match(job, target);
+}
+
+static void on_find_changed(GtkSearchEntry *entry, gpointer user_data) {
+    // Search as the query is typed, the entry waits for a pause
+    start_search(user_data);
+}
+
+static void on_find_regex_toggled(GtkToggleButton *button, gpointer user_data) {
+    start_search(user_data);
+}
+
+static void on_find_entry_activate(GtkEntry *entry, gpointer user_data) {
+    // Enter goes further back through the scrollback
+    move_search_match(user_data, TRUE);
+}
+
+static void on_find_previous_clicked(GtkButton *button, gpointer user_data) {
+    move_search_match(user_data, TRUE);
+}
+
+static void on_find_next_clicked(GtkButton *button, gpointer user_data) {
+    move_search_match(user_data, FALSE);
+}
+
+static void close_find_bar(WindowData *window_data) {
+    VteTerminal *terminal = get_current_terminal(window_data);
+
+    cancel_search(window_data);
+    gtk_revealer_set_reveal_child(GTK_REVEALER(window_data->find_bar), FALSE);
+    if (terminal) {
+        gtk_widget_grab_focus(GTK_WIDGET(terminal));
+    }
+}
+
+static void on_find_stopped(GtkSearchEntry *entry, gpointer user_data) {
+    // Escape in the entry
+    close_find_bar(user_data);
+}
+
+static void on_find_close_clicked(GtkButton *button, gpointer user_data) {
+    close_find_bar(user_data);
+}
+
+static void on_find_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+
+    // Focusing the entry selects the last query, ready to be typed over
+    gtk_revealer_set_reveal_child(GTK_REVEALER(window_data->find_bar), TRUE);
+    gtk_widget_grab_focus(window_data->find_entry);
+}
+
+static GtkWidget* create_find_bar(WindowData *window_data) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 4);
+
+    // Query, the mode it is matched in, and how many lines match
+    window_data->find_entry = gtk_search_entry_new();
+    window_data->find_regex = gtk_check_button_new_with_label("Regex");
+    window_data->find_status = gtk_label_new(NULL);
+    g_signal_connect(window_data->find_entry, "search-changed", G_CALLBACK(on_find_changed), window_data);
+    g_signal_connect(window_data->find_entry, "activate", G_CALLBACK(on_find_entry_activate), window_data);
+    g_signal_connect(window_data->find_entry, "stop-search", G_CALLBACK(on_find_stopped), window_data);
+    g_signal_connect(window_data->find_regex, "toggled", G_CALLBACK(on_find_regex_toggled), window_data);
+    gtk_box_pack_start(GTK_BOX(box), window_data->find_entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(box), window_data->find_regex, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), window_data->find_status, FALSE, FALSE, 0);
+
+    // Buttons moving to the match above and below, and closing the bar
+    GtkWidget *previous_button = gtk_button_new_from_icon_name("go-up-symbolic", GTK_ICON_SIZE_BUTTON);
+    GtkWidget *next_button = gtk_button_new_from_icon_name("go-down-symbolic", GTK_ICON_SIZE_BUTTON);
+    GtkWidget *close_button = gtk_button_new_from_icon_name("window-close-symbolic", GTK_ICON_SIZE_BUTTON);
+    g_signal_connect(previous_button, "clicked", G_CALLBACK(on_find_previous_clicked), window_data);
+    g_signal_connect(next_button, "clicked", G_CALLBACK(on_find_next_clicked), window_data);
+    g_signal_connect(close_button, "clicked", G_CALLBACK(on_find_close_clicked), window_data);
+    gtk_box_pack_start(GTK_BOX(box), previous_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), next_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), close_button, FALSE, FALSE, 0);
+
+    // Hidden until "Find" is used
+    window_data->find_bar = gtk_revealer_new();
+    gtk_container_add(GTK_CONTAINER(window_data->find_bar), box);
+
+    return window_data->find_bar;
+}
+
+static void fill_edit_menu(GtkWidget *edit_menu, WindowData *window_data) {
+    GtkWidget *copy_item = create_action_menu_item("Copy", "copy", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), copy_item);
+
+    GtkWidget *paste_item = create_action_menu_item("Paste", "paste", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), paste_item);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *find_item = create_action_menu_item("Find...", "find", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), find_item);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *clear_scrollback = create_action_menu_item("Clear Scrollback", "clear-scrollback", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), clear_scrollback);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *zoom_in = create_action_menu_item("Zoom In", "zoom-in", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_in);
+
+    GtkWidget *zoom_out = create_action_menu_item("Zoom Out", "zoom-out", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_out);
+
+    GtkWidget *zoom_reset = create_action_menu_item("Zoom Reset", "zoom-reset", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), zoom_reset);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *preferences = create_action_menu_item("Preferences", "preferences", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), preferences);
+}
+
+static gchar* run_name_tab_dialog(GtkWindow *parent, const gchar *current_name) {
+    // Create a small dialog asking for the tab name
+    GtkWidget *dialog = gtk_dialog_new();
+    gtk_window_set_title(GTK_WINDOW(dialog), "Name Tab");
+    gtk_window_set_transient_for(GTK_WINDOW(dialog), parent);
+    gtk_window_set_modal(GTK_WINDOW(dialog), TRUE);
+    gtk_window_set_resizable(GTK_WINDOW(dialog), FALSE);
+
+    // Add an entry holding the current name, confirmed with Enter
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_container_set_border_width(GTK_CONTAINER(content_area), 10);
+    GtkWidget *entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(entry), current_name);
+    gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+    gtk_container_add(GTK_CONTAINER(content_area), entry);
+
+    // Add "Cancel" and "OK" buttons to the dialog
+    gtk_dialog_add_button(GTK_DIALOG(dialog), "Cancel", GTK_RESPONSE_CANCEL);
+    gtk_dialog_add_button(GTK_DIALOG(dialog), "OK", GTK_RESPONSE_OK);
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+    gtk_widget_show_all(dialog);
+
+    // Return the new name, or NULL if the dialog was cancelled
+    gchar *name = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        name = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+    }
+    gtk_widget_destroy(dialog);
+
+    return name;
+}
+
+void on_name_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    TerminalData *data = get_current_tab(window_data);
+
+    // Ask for the new name
+    gchar *name = run_name_tab_dialog(GTK_WINDOW(window_data->window), get_tab_title(data));
+    if (!name) {
+        return;
+    }
+
+    // An empty name goes back to the terminal title
+    g_free(data->custom_title);
+    data->custom_title = *g_strstrip(name) ? name : NULL;
+    if (!data->custom_title) {
+        g_free(name);
+    }
+
+    update_tab_title(data);
+    record_session_tab_name(data);
+}
+
+void on_previous_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+
+    // Switch to the previous tab, wrapping around at the first one
+    gint page = gtk_notebook_get_current_page(notebook);
+    gint pages = gtk_notebook_get_n_pages(notebook);
+    gtk_notebook_set_current_page(notebook, (page + pages - 1) % pages);
+}
+
+void on_next_tab_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    WindowData *window_data = user_data;
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+
+    // Switch to the next tab, wrapping around at the last one
+    gint page = gtk_notebook_get_current_page(notebook);
+    gint pages = gtk_notebook_get_n_pages(notebook);
+    gtk_notebook_set_current_page(notebook, (page + 1) % pages);
+}
+
+static void move_current_tab(WindowData *window_data, gint offset) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+    TerminalData *data = get_current_tab(window_data);
+
+    // Move the current tab by the offset, stopping at either end
+    gint position = gtk_notebook_get_current_page(notebook) + offset;
+    if (position >= 0 && position < gtk_notebook_get_n_pages(notebook)) {
+        gtk_notebook_reorder_child(notebook, data->page, position);
+    }
+}
+
+void on_move_tab_left_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Move the current tab one position to the left
+    move_current_tab(user_data, -1);
+}
+
+void on_move_tab_right_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Move the current tab one position to the right
+    move_current_tab(user_data, 1);
+}
+
+static void fill_tabs_menu(GtkWidget *tabs_menu, WindowData *window_data) {
+    GtkWidget *name_tab = create_action_menu_item("Name Tab", "name-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), name_tab);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *previous_tab = create_action_menu_item("Previous Tab", "previous-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), previous_tab);
+
+    GtkWidget *next_tab = create_action_menu_item("Next Tab", "next-tab", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), next_tab);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *move_tab_left = create_action_menu_item("Move Tab Left", "move-tab-left", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), move_tab_left);
+
+    GtkWidget *move_tab_right = create_action_menu_item("Move Tab Right", "move-tab-right", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), move_tab_right);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *split_right = create_action_menu_item("Split Right", "split-right", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), split_right);
+
+    GtkWidget *split_down = create_action_menu_item("Split Down", "split-down", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), split_down);
+
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), gtk_separator_menu_item_new());
+
+    GtkWidget *broadcast_input = create_action_menu_item("Broadcast Input", "broadcast-input", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), broadcast_input);
+
+    GtkWidget *broadcast_window = create_action_menu_item("Broadcast to All Tabs", "broadcast-window", window_data);
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), broadcast_window);
+}
+
+// Set the properties of a window, such as title, modal behavior, and resizable state
+void set_window_properties(GtkWidget *window, const gchar *title, GtkWindow *parent, gboolean modal, gboolean resizable) {
+    // Set the window title
+    gtk_window_set_title(GTK_WINDOW(window), title); 
+    // Set modal behavior (whether it blocks input to other windows)
+    gtk_window_set_modal(GTK_WINDOW(window), modal); 
+    // Set the parent window for the transient behavior
+    gtk_window_set_transient_for(GTK_WINDOW(window), GTK_WINDOW(parent)); 
+    // Set the resizable state of the window
+    gtk_window_set_resizable(GTK_WINDOW(window), resizable); 
+}
+
+// Create a header bar widget with the specified title
+GtkWidget* create_header_bar(const gchar *title) {
+    // Create a new header bar widget
+    GtkWidget *header = gtk_header_bar_new(); 
+    // Set the title of the header bar
+    gtk_header_bar_set_title(GTK_HEADER_BAR(header), title); 
+    // Show the close button on the header bar
+    gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(header), TRUE); 
+    // Return the created header bar widget
+    return header; 
+}
+
+// Load an image file, decoding each file only once per process; a file that failed to load stays NULL
+static GdkPixbuf* load_cached_pixbuf(const gchar *filename) {
+    static GHashTable *pixbufs = NULL;
+    gpointer pixbuf;
+
+    if (!pixbufs) {
+        pixbufs = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    if (!g_hash_table_lookup_extended(pixbufs, filename, NULL, &pixbuf)) {
+        pixbuf = gdk_pixbuf_new_from_file(filename, NULL);
+        g_hash_table_insert(pixbufs, g_strdup(filename), pixbuf);
+    }
+
+    return pixbuf;
+}
+
+// Create an image widget with the specified image file
+GtkWidget* create_image(const gchar *filename) {
+    // Create a new image widget sharing the decoded file with every other image of it
+    GtkWidget *image = gtk_image_new_from_pixbuf(load_cached_pixbuf(filename)); 
+    // Return the created image widget
+    return image; 
+}
+
+// Create a label widget with the specified markup text
+GtkWidget* create_label_with_markup(const gchar *markup) {
+    // Create a new label widget
+    GtkWidget *label = gtk_label_new(NULL); 
+    // Set the markup text for the label
+    gtk_label_set_markup(GTK_LABEL(label), markup); 
+    // Return the created label widget
+    return label; 
+}
+
+// Create a separator widget with the specified orientation
+GtkWidget* create_separator(GtkOrientation orientation) {
+    // Create a new separator widget with the specified orientation
+    GtkWidget *separator = gtk_separator_new(orientation); 
+    // Return the created separator widget
+    return separator; 
+}
+
+// Create a link button widget with the specified URI and label text
+GtkWidget* create_link_button(const gchar *uri, const gchar *label) {
     // Create a new link button widget with the specified URI and label
     GtkWidget *link_button = gtk_link_button_new_with_label(uri, label); 
     // Return the created link button widget
     return link_button; 
 }
 
-// Create a tab widget within a notebook widget, with the specified label markup
-GtkWidget* create_tab_with_label(GtkWidget *notebook, const gchar *label_markup) {
-    // Create a new box widget as the tab
-    GtkWidget *tab = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5); 
-    // Append the tab to the notebook
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), tab, gtk_label_new(NULL)); 
-    // Set the label markup for the tab
-    gtk_label_set_markup(GTK_LABEL(gtk_notebook_get_tab_label(GTK_NOTEBOOK(notebook), tab)), label_markup); 
-    // Return the created tab widget
-    return tab; 
+// Create a tab widget within a notebook widget, with the specified label markup
+GtkWidget* create_tab_with_label(GtkWidget *notebook, const gchar *label_markup) {
+    // Create a new box widget as the tab
+    GtkWidget *tab = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5); 
+    // Append the tab to the notebook
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), tab, gtk_label_new(NULL)); 
+    // Set the label markup for the tab
+    gtk_label_set_markup(GTK_LABEL(gtk_notebook_get_tab_label(GTK_NOTEBOOK(notebook), tab)), label_markup); 
+    // Return the created tab widget
+    return tab; 
+}
+
+void create_about_tab(GtkWidget *notebook)
+{
+    // Create the "About" tab
+    GtkWidget *about_tab = create_tab_with_label(notebook, "<b>About</b>");
+
+    // Add logo image
+    GtkWidget *logo = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
+    gtk_box_pack_start(GTK_BOX(about_tab), logo, FALSE, FALSE, 0);
+
+    // Add label for the application name
+    GtkWidget *label = create_label_with_markup("<big><b>IllumiTerm</b></big>");
+    gtk_box_pack_start(GTK_BOX(about_tab), label, FALSE, FALSE, 0);
+
+    // Add a separator
+    GtkWidget *separator = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(about_tab), separator, FALSE, FALSE, 0);
+
+    // Add description label
+    GtkWidget *description = create_label_with_markup("<b>Programming has always fascinated me, and I have always been interested\n"
+                                                      "in learning new languages and exploring different software development tools.\n"
+                                                      "Recently, I decided to take my programming skills to the next level by learning C\n"
+                                                      "and creating my own custom terminal. It was a challenging yet rewarding experience\n"
+                                                      "that helped me develop my programming skills in many ways.\n"
+                                                      "\n"
+                                                      "My journey started with the decision to learn C. I had heard a lot about\n"
+                                                      "the language's speed, efficiency, and low-level programming capabilities,\n"
+                                                      "and I was excited to explore it. I started with the basics, such as data types,\n"
+                                                      "operators, and control statements, and gradually moved on to more advanced topics,\n"
+                                                      "such as pointers, structures, and file handling.</b>");
+
+    gtk_label_set_justify(GTK_LABEL(description), GTK_JUSTIFY_CENTER);
+    gtk_box_pack_start(GTK_BOX(about_tab), description, TRUE, TRUE, 0);
+
+    // Add another separator
+    GtkWidget *separator1 = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(about_tab), separator1, FALSE, FALSE, 0);
+
+    // Add a link button
+    GtkWidget *link_button = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
+    gtk_box_pack_start(GTK_BOX(about_tab), link_button, FALSE, FALSE, 0);
+    
+    // Add a label for the copyright notice
+    GtkWidget *copy = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
+    gtk_box_pack_end(GTK_BOX(about_tab), copy, FALSE, FALSE, 0);
+}
+
+void create_credits_tab(GtkWidget *notebook)
+{
+    // Create the "Credits" tab
+    GtkWidget *credits_tab = create_tab_with_label(notebook, "<b>Credits</b>");
+
+    // Add logo image
+    GtkWidget *logo1 = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
+    gtk_box_pack_start(GTK_BOX(credits_tab), logo1, FALSE, FALSE, 0);
+
+    // Add label for the credits section
+    GtkWidget *credits_label = create_label_with_markup("<big><b>Credits</b></big>");
+    gtk_box_pack_start(GTK_BOX(credits_tab), credits_label, TRUE, TRUE, 0);
+
+    // Add a separator
+    GtkWidget *separator2 = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(credits_tab), separator2, FALSE, FALSE, 0);
+    
+    // Add credits list label
+    GtkWidget *credits_list = gtk_label_new("<b>Dear GTK and VTE developers,</b>\n\n"
+                                            "<b>Your attention to detail and commitment to open-source principles have made a\n"
+                                            "significant impact on the software development community as a whole.\n\n"
+                                            "Your contributions have helped countless developers around the world\n"
+                                            "to create high-quality, reliable applications that are accessible to everyone.</b>\n\n"
+                                            "<b>Thank you for all that you do. Your work is greatly appreciated and will continue to\n"
+                                            "make a positive difference in the world of software development for years to come.</b>\n\n"
+                                            "<b>Sincerely,</b>\n"
+                                            "<b>Elijah Gordon</b>");
+
+    gtk_label_set_use_markup(GTK_LABEL(credits_list), TRUE);
+    gtk_label_set_justify(GTK_LABEL(credits_list), GTK_JUSTIFY_CENTER);
+    gtk_box_pack_start(GTK_BOX(credits_tab), credits_list, FALSE, FALSE, 0);
+
+    // Add another separator
+    GtkWidget *separator3 = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(credits_tab), separator3, FALSE, FALSE, 0);
+
+    // Add a label for the copyright notice
+    GtkWidget *copy = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
+    gtk_box_pack_end(GTK_BOX(credits_tab), copy, FALSE, FALSE, 0);
+
+    // Add a link button
+    GtkWidget *link_button1 = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
+    gtk_box_pack_start(GTK_BOX(credits_tab), link_button1, FALSE, FALSE, 0);
+}
+
+void create_license_tab(GtkWidget *notebook)
+{
+    // Create the "License" tab
+    GtkWidget *license_tab = create_tab_with_label(notebook, "<b>License</b>");
+
+    // Add a label for the copyright notice
+    GtkWidget *copy1 = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
+    gtk_box_pack_end(GTK_BOX(license_tab), copy1, FALSE, FALSE, 0);
+
+    // Add logo image
+    GtkWidget *logo2 = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
+    gtk_box_pack_start(GTK_BOX(license_tab), logo2, FALSE, FALSE, 0);
+
+    // Add label for the license section
+    GtkWidget *license_label = create_label_with_markup("<big><b>License</b></big>");
+    gtk_box_pack_start(GTK_BOX(license_tab), license_label, FALSE, FALSE, 0);
+
+    // Add a separator
+    GtkWidget *separator4 = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(license_tab), separator4, FALSE, FALSE, 0);
+    
+    // Add license description label
+    GtkWidget *license_description = gtk_label_new("<b>This program is free software; you can redistribute it and/or\n"
+                                                   "modify it under the terms of the GNU General Public License\n"
+                                                   "as published by the Free Software Foundation; either version 2\n"
+                                                   "of the License, or (at your option) any later version.</b>\n\n"
+                                                   "<b>This program is distributed in the hope that it will be useful,\n"
+                                                   "but WITHOUT ANY WARRANTY; without even the implied warranty of\n"
+                                                   "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
+                                                   "GNU General Public License for more details.</b>\n\n"
+                                                   "<b>You should have received a copy of the GNU General Public License\n"
+                                                   "along with this program; if not, write to the Free Software\n"
+                                                   "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.</b>");
+
+    gtk_label_set_use_markup(GTK_LABEL(license_description), TRUE);
+    gtk_label_set_justify(GTK_LABEL(license_description), GTK_JUSTIFY_CENTER);
+    gtk_box_pack_start(GTK_BOX(license_tab), license_description, FALSE, FALSE, 0);
+
+    // Add another separator
+    GtkWidget *separator5 = create_separator(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(license_tab), separator5, FALSE, FALSE, 0);
+
+    // Add a link button
+    GtkWidget *link_button2 = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
+    gtk_box_pack_start(GTK_BOX(license_tab), link_button2, FALSE, FALSE, 0);
+}
+
+// The About window, built the first time it is opened and hidden rather than destroyed when closed
+static GtkWidget *about_window = NULL;
+
+void create_about_window(GtkWindow *parent)
+{
+    // Show the window built before in front of the new parent
+    if (about_window) {
+        gtk_window_set_transient_for(GTK_WINDOW(about_window), parent);
+        gtk_window_present(GTK_WINDOW(about_window));
+        return;
+    }
+
+    // Create the about window
+    about_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    set_window_properties(about_window, "About IllumiTerm", parent, TRUE, FALSE);
+    g_signal_connect(about_window, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+    g_signal_connect(about_window, "destroy", G_CALLBACK(gtk_widget_destroyed), &about_window);
+
+    // Create a header bar for the about window
+    GtkWidget *header = create_header_bar("About IllumiTerm");
+    gtk_window_set_titlebar(GTK_WINDOW(about_window), header);
+
+    // Create a notebook widget to hold the tabs
+    GtkWidget *notebook = gtk_notebook_new();
+    gtk_container_add(GTK_CONTAINER(about_window), notebook);
+
+    // Create the "About" tab
+    create_about_tab(notebook);
+
+    // Create the "Credits" tab
+    create_credits_tab(notebook);
+
+    // Create the "License" tab
+    create_license_tab(notebook);
+
+    // Show all widgets in the about window
+    gtk_widget_show_all(about_window);
+}
+
+void on_about_activate(GtkMenuItem *menuitem, gpointer user_data) {
+    // Cast the user data parameter to GtkWindow* type
+    GtkWindow* window = GTK_WINDOW(user_data);
+    
+    // Call the create_about_window function to create and show the About window
+    create_about_window(window);
+}
+
+static GtkWidget* create_about_menu_item() {
+    // Create a new menu item with the label "About"
+    GtkWidget* about_menu_item = gtk_menu_item_new_with_label("About");
+    
+    // Connect the "activate" signal of the menu item to the on_about_activate callback function
+    g_signal_connect(about_menu_item, "activate", G_CALLBACK(on_about_activate), NULL);
+    
+    // Return the created menu item
+    return about_menu_item;
+}
+
+static void fill_help_menu(GtkWidget *help_menu, WindowData *window_data) {
+    // Create the "About" menu item using the create_about_menu_item function
+    GtkWidget* about_menu_item = create_about_menu_item();
+    
+    // Append the "About" menu item to the help menu
+    gtk_menu_shell_append(GTK_MENU_SHELL(help_menu), about_menu_item);
+}
+
+// Menus of the menu bar, each filled the first time it is opened
+typedef struct {
+    const gchar *label;
+    void (*fill)(GtkWidget *menu, WindowData *window_data);
+} MenuBarMenu;
+
+static const MenuBarMenu menu_bar_menus[] = {
+    { "File", fill_file_menu },
+    { "Edit", fill_edit_menu },
+    { "Tabs", fill_tabs_menu },
+    { "Help", fill_help_menu },
+};
+
+static void fill_menu_bar_menu(GtkMenuItem *item, gpointer user_data) {
+    const MenuBarMenu *menu_bar_menu = g_object_get_data(G_OBJECT(item), "menu-bar-menu");
+    GtkWidget *menu = gtk_menu_item_get_submenu(item);
+
+    // Fill the menu once; it has just been popped up empty, so place it again at its full size
+    g_signal_handlers_disconnect_by_func(item, fill_menu_bar_menu, user_data);
+    menu_bar_menu->fill(menu, user_data);
+    gtk_widget_show_all(menu);
+    gtk_menu_reposition(GTK_MENU(menu));
+}
+
+static GtkWidget* create_menu(WindowData *window_data) {
+    // Create the menu bar
+    GtkWidget *menu_bar = gtk_menu_bar_new();
+
+    // Create its menu items with empty menus; most windows never open them, and shortcuts do not need them
+    for (guint i = 0; i < G_N_ELEMENTS(menu_bar_menus); ++i) {
+        GtkWidget *item = gtk_menu_item_new_with_label(menu_bar_menus[i].label);
+        gtk_menu_item_set_submenu(GTK_MENU_ITEM(item), gtk_menu_new());
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), item);
+
+        g_object_set_data(G_OBJECT(item), "menu-bar-menu", (gpointer) &menu_bar_menus[i]);
+        g_signal_connect(item, "select", G_CALLBACK(fill_menu_bar_menu), window_data);
+    }
+
+    // Return the menu bar
+    return menu_bar;
+}
+
+void set_notebook_show_tabs(GtkWidget* notebook) {
+    // Set the property to hide the tabs in the notebook until a second tab is opened
+    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
+
+    // Let many tabs scroll instead of widening the window
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
+}
+
+static GtkWidget* create_notebook(WindowData *window_data) {
+    GtkWidget *notebook = gtk_notebook_new();
+    set_notebook_show_tabs(notebook);
+    window_data->notebook = notebook;
+
+    // Start terminals lazily and follow the shown tab with the window title
+    g_signal_connect_after(notebook, "switch-page", G_CALLBACK(switch_page), NULL);
+
+    // Show the tab bar only while there is more than one tab
+    g_signal_connect(notebook, "page-added", G_CALLBACK(update_show_tabs), NULL);
+    g_signal_connect(notebook, "page-removed", G_CALLBACK(update_show_tabs), NULL);
+
+    // The notebook is sized to the window; each terminal scrolls its own buffer
+    gtk_widget_show(notebook);
+
+    return notebook;
+}
+
+static GtkWidget* create_window(GtkWidget* menu_bar, GtkWidget* notebook, GtkWidget* find_bar) {
+    // Create a new top-level window
+    GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    
+    // Create a vertical box container to hold the menu bar and notebook
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    
+    // Set the window icon, decoded by the first window only
+    gtk_window_set_icon(GTK_WINDOW(window), load_cached_pixbuf("/usr/share/icons/hicolor/48x48/apps/illumiterm.png"));
+    
+    // Pack the menu bar at the top of the vertical box container
+    gtk_box_pack_start(GTK_BOX(vbox), menu_bar, FALSE, FALSE, 0);
+    
+    // Pack the notebook to fill the remaining space in the vertical box container
+    gtk_box_pack_start(GTK_BOX(vbox), notebook, TRUE, TRUE, 0);
+    
+    // Pack the find bar below the notebook
+    gtk_box_pack_start(GTK_BOX(vbox), find_bar, FALSE, FALSE, 0);
+    
+    // Add the vertical box container to the window
+    gtk_container_add(GTK_CONTAINER(window), vbox);
+    
+    // Set the window title to NULL (empty)
+    gtk_window_set_title(GTK_WINDOW(window), NULL);
+    
+    // Set the default size of the window to 640x460 pixels
+    gtk_window_set_default_size(GTK_WINDOW(window), 640, 460);
+    
+    // Clear the window icon name
+    gtk_window_set_icon_name(GTK_WINDOW(window), NULL);
+    
+    // Show all the widgets within the window
+    gtk_widget_show_all(window);
+
+    // Return the created window
+    return window;
+}
+
+static void free_window_data(gpointer user_data) {
+    WindowData *window_data = user_data;
+
+    if (window_data->frame_times) {
+        g_array_free(window_data->frame_times, TRUE);
+    }
+    if (window_data->frame_cap_source) {
+        g_source_remove(window_data->frame_cap_source);
+    }
+    g_free(window_data);
+}
+
+static void frame_paint_started(GdkFrameClock *clock, gpointer user_data) {
+    // Remember when the frame clock started working on this frame
+    get_window_data(user_data)->frame_start = g_get_monotonic_time();
+}
+
+static void frame_paint_finished(GdkFrameClock *clock, gpointer user_data) {
+    WindowData *window_data = get_window_data(user_data);
+
+    // Record the time from the start of the frame until it was painted
+    gint64 frame_time = g_get_monotonic_time() - window_data->frame_start;
+    g_array_append_val(window_data->frame_times, frame_time);
+}
+
+static gint compare_frame_times(gconstpointer a, gconstpointer b) {
+    gint64 first = *(const gint64 *) a, second = *(const gint64 *) b;
+
+    return first < second ? -1 : first > second;
+}
+
+static void print_frame_stats(GtkWidget *window, gpointer user_data) {
+    GArray *frame_times = get_window_data(window)->frame_times;
+
+    // Title changes are counted for the whole process
+    g_print("frame-stats: %" G_GUINT64_FORMAT " title updates, %" G_GUINT64_FORMAT " dropped\n",
+            title_updates_requested, title_updates_dropped);
+
+    if (frame_times->len == 0) {
+        g_print("frame-stats: no frames painted\n");
+        return;
+    }
+
+    // Report the distribution of the frame times in milliseconds
+    g_array_sort(frame_times, compare_frame_times);
+
+    gint64 total = 0;
+    for (guint i = 0; i < frame_times->len; ++i) {
+        total += g_array_index(frame_times, gint64, i);
+    }
+
+    g_print("frame-stats: %u frames, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            frame_times->len,
+            total / 1000.0 / frame_times->len,
+            g_array_index(frame_times, gint64, frame_times->len / 2) / 1000.0,
+            g_array_index(frame_times, gint64, frame_times->len * 99 / 100) / 1000.0,
+            g_array_index(frame_times, gint64, frame_times->len - 1) / 1000.0);
+}
+
+static void record_frame_stats(WindowData *window_data) {
+    // The window is realized by now, so its frame clock exists
+    GdkFrameClock *clock = gtk_widget_get_frame_clock(window_data->window);
+
+    window_data->frame_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+    g_signal_connect_object(clock, "before-paint", G_CALLBACK(frame_paint_started), window_data->window, 0);
+    g_signal_connect_object(clock, "after-paint", G_CALLBACK(frame_paint_finished), window_data->window, 0);
+    g_signal_connect(window_data->window, "destroy", G_CALLBACK(print_frame_stats), NULL);
+}
+
+static void record_latency(LatencyHistogram *histogram, gint64 latency) {
+    histogram->buckets[MIN(latency / LATENCY_BUCKET_WIDTH, LATENCY_BUCKETS)]++;
+    histogram->count++;
+    histogram->max = MAX(histogram->max, latency);
+}
+
+static gdouble get_latency_percentile(const LatencyHistogram *histogram, guint percent) {
+    // Upper bound of the bucket holding the sample at the percentile, in milliseconds
+    guint64 rank = (histogram->count * percent + 99) / 100, seen = 0;
+
+    for (guint i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            return (i + 1) * LATENCY_BUCKET_WIDTH / 1000.0;
+        }
+    }
+
+    // The sample is in the overflow bucket, of which only the maximum is known
+    return histogram->max / 1000.0;
+}
+
+static void latency_frame_painted(GdkFrameClock *clock, gpointer user_data) {
+    WindowData *window_data = get_window_data(user_data);
+
+    // Only frames painted after the answer to a keystroke complete a sample
+    if (!window_data->latency_output_time) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    record_latency(&latency_input_to_output, window_data->latency_output_time - window_data->latency_key_time);
+    record_latency(&latency_output_to_paint, now - window_data->latency_output_time);
+    record_latency(&latency_input_to_paint, now - window_data->latency_key_time);
+
+    window_data->latency_terminal = 0;
+    window_data->latency_key_time = 0;
+    window_data->latency_output_time = 0;
 }
 
-void create_about_tab(GtkWidget *notebook)
-{
-    // Create the "About" tab
-    GtkWidget *about_tab = create_tab_with_label(notebook, "<b>About</b>");
+static void trace_window_latency(WindowData *window_data) {
+    g_signal_connect_object(gtk_widget_get_frame_clock(window_data->window), "after-paint", G_CALLBACK(latency_frame_painted), window_data->window, 0);
+}
 
-    // Add logo image
-    GtkWidget *logo = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
-    gtk_box_pack_start(GTK_BOX(about_tab), logo, FALSE, FALSE, 0);
+static void format_latency_histogram(GString *report, const gchar *name, const LatencyHistogram *histogram) {
+    if (histogram->count == 0) {
+        g_string_append_printf(report, "trace-latency: %s no samples\n", name);
+        return;
+    }
+
+    g_string_append_printf(report, "trace-latency: %s %" G_GUINT64_FORMAT " samples, p50 %.1f ms, p99 %.1f ms, max %.3f ms\n",
+                           name, histogram->count, get_latency_percentile(histogram, 50),
+                           get_latency_percentile(histogram, 99), histogram->max / 1000.0);
+
+    // One line per non-empty bucket, giving its upper bound in milliseconds and its sample count
+    for (guint i = 0; i <= LATENCY_BUCKETS; ++i) {
+        if (histogram->buckets[i] == 0) {
+            continue;
+        }
+
+        if (i < LATENCY_BUCKETS) {
+            g_string_append_printf(report, "trace-latency: %s le %.1f %" G_GUINT64_FORMAT "\n",
+                                   name, (i + 1) * LATENCY_BUCKET_WIDTH / 1000.0, histogram->buckets[i]);
+        } else {
+            g_string_append_printf(report, "trace-latency: %s le inf %" G_GUINT64_FORMAT "\n", name, histogram->buckets[i]);
+        }
+    }
+}
+
+static GString* format_latency_report() {
+    GString *report = g_string_new(NULL);
+
+    g_string_append_printf(report, "trace-latency: %" G_GUINT64_FORMAT " keystrokes without output\n", latency_unanswered);
+    format_latency_histogram(report, "input-to-output", &latency_input_to_output);
+    format_latency_histogram(report, "output-to-paint", &latency_output_to_paint);
+    format_latency_histogram(report, "input-to-paint", &latency_input_to_paint);
+
+    return report;
+}
+
+static void free_latency_report(gpointer user_data) {
+    g_string_free(user_data, TRUE);
+}
+
+static void latency_report_written(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    // The scraper gets the report and the end of the stream; it may have gone away already
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source_object), result, NULL, NULL);
+    g_object_unref(user_data);
+}
+
+static gboolean latency_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    // Send the report as it stands and close the connection once written; the connection keeps the text alive
+    GString *report = format_latency_report();
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+    g_object_set_data_full(G_OBJECT(connection), "latency-report", report, free_latency_report);
+    g_output_stream_write_all_async(output, report->str, report->len, G_PRIORITY_DEFAULT, NULL,
+                                    latency_report_written, g_object_ref(connection));
+
+    return TRUE;
+}
+
+static void stop_latency_trace(GApplication *application, gpointer user_data) {
+    // Print the final report when the application exits
+    GString *report = format_latency_report();
+    g_print("%s", report->str);
+    g_string_free(report, TRUE);
+
+    if (latency_service) {
+        g_socket_service_stop(latency_service);
+        g_socket_listener_close(G_SOCKET_LISTENER(latency_service));
+        g_unlink(latency_socket_path);
+        g_clear_object(&latency_service);
+        g_clear_pointer(&latency_socket_path, g_free);
+    }
+}
+
+static void listen_latency_socket(const gchar *path) {
+    GSocketAddress *address = g_unix_socket_address_new(path);
+    GError *error = NULL;
+
+    // Replace a socket left behind by an earlier run
+    g_unlink(path);
+
+    // Only the user may connect: the socket is created without any permission for group and others
+    latency_service = g_socket_service_new();
+    mode_t mask = umask(0077);
+    gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(latency_service), address, G_SOCKET_TYPE_STREAM,
+                                                       G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error);
+    umask(mask);
+
+    if (!listening) {
+        g_warning("Unable to listen on %s: %s", path, error->message);
+        g_error_free(error);
+        g_clear_object(&latency_service);
+    } else {
+        latency_socket_path = g_strdup(path);
+        g_signal_connect(latency_service, "incoming", G_CALLBACK(latency_incoming), NULL);
+        g_socket_service_start(latency_service);
+    }
+
+    g_object_unref(address);
+}
+
+static void start_latency_trace(GApplication *application, const gchar *socket_path) {
+    // Tracing stays on for the rest of the process once a command line asked for it
+    if (!latency_trace_enabled) {
+        latency_trace_enabled = TRUE;
+        g_signal_connect(application, "shutdown", G_CALLBACK(stop_latency_trace), NULL);
+
+        // Windows and terminals created from now on hook themselves up, the open ones are hooked up here
+        for (GList *item = windows; item; item = item->next) {
+            trace_window_latency(item->data);
+        }
+        for (GList *item = terminals; item; item = item->next) {
+            trace_terminal_latency(item->data);
+        }
+        for (GList *item = terminal_pool.head; item; item = item->next) {
+            trace_terminal_latency(item->data);
+        }
+    }
+
+    // Serve the report for live scraping as well
+    if (socket_path && !latency_service) {
+        listen_latency_socket(socket_path);
+    }
+}
+
+static gboolean session_window_configured(GtkWidget *window, GdkEventConfigure *event, gpointer user_data) {
+    WindowData *window_data = get_window_data(window);
+    gint width, height;
+
+    // Record the size once it has changed, not every move
+    gtk_window_get_size(GTK_WINDOW(window), &width, &height);
+    if (width != window_data->session_width || height != window_data->session_height) {
+        record_session_window(window_data);
+    }
+
+    return FALSE;
+}
+
+static void session_tabs_reordered(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
+    record_session_tab_order(user_data);
+}
+
+static void session_window_closed(GtkWidget *window, gpointer user_data) {
+    WindowData *window_data = get_window_data(window);
+
+    // The last window stays in the session, to be restored the next time
+    if (windows->next) {
+        record_session_closed('X', window_data->session_id);
+    }
+    windows = g_list_remove(windows, window_data);
+}
+
+static WindowData* create_terminal_window() {
+    // Create the per-window state shared by the menus, the notebook and the tabs
+    WindowData *window_data = g_new0(WindowData, 1);
+    window_data->session_id = next_window_id++;
+
+    // Create the menu bar
+    GtkWidget* menu_bar = create_menu(window_data);
+    
+    // Create the notebook
+    GtkWidget* notebook = create_notebook(window_data);
+    
+    // Create the find bar
+    GtkWidget* find_bar = create_find_bar(window_data);
+    
+    // Create the main window
+    GtkWidget* window = create_window(menu_bar, notebook, find_bar);
+    window_data->window = window;
+    g_object_set_data_full(G_OBJECT(window), "window-data", window_data, free_window_data);
+
+    // Connect the delete-event signal of the window widget to the corresponding handler
+    connect_delete_event_signal(window);
+
+    // Throttle the terminals of a minimized window
+    g_signal_connect(window, "window-state-event", G_CALLBACK(window_state_changed), NULL);
+
+    // Keep track of the window and record it in the session
+    windows = g_list_append(windows, window_data);
+    record_session_window(window_data);
+    g_signal_connect(window, "configure-event", G_CALLBACK(session_window_configured), NULL);
+    g_signal_connect(window, "destroy", G_CALLBACK(session_window_closed), NULL);
+    g_signal_connect(window_data->notebook, "page-reordered", G_CALLBACK(session_tabs_reordered), window_data);
+
+    // Freeze the window again after each frame let through while a terminal floods
+    g_signal_connect_object(gtk_widget_get_frame_clock(window), "after-paint", G_CALLBACK(capped_frame_painted), window, 0);
+
+    // Measure how long the window takes to produce each frame
+    if (frame_stats_enabled) {
+        record_frame_stats(window_data);
+    }
+
+    // Finish the samples of traced keystrokes when their output has been painted
+    if (latency_trace_enabled) {
+        trace_window_latency(window_data);
+    }
+
+    return window_data;
+}
+
+static void open_daemon_request(gchar *request, gsize length) {
+    // A request is a sequence of records, each a tag character followed by a NUL-terminated value:
+    // 'C' the working directory, 'A' one argument of the command to run, 'E' one environment variable.
+    // The environment keeps the request buffer and points into it instead of copying the variables.
+    const gchar *cwd = NULL;
+    GPtrArray *argv = g_ptr_array_new();
+    GPtrArray *envv = g_ptr_array_new();
+
+    for (gchar *record = request, *end = request + length; record < end; ) {
+        gchar *record_end = memchr(record, '\0', end - record);
+
+        // Ignore a truncated last record
+        if (!record_end) {
+            break;
+        }
+
+        switch (record[0]) {
+            case 'C':
+                cwd = record + 1;
+                break;
+            case 'A':
+                g_ptr_array_add(argv, g_strdup(record + 1));
+                break;
+            case 'E':
+                g_ptr_array_add(envv, record + 1);
+                break;
+        }
+
+        record = record_end + 1;
+    }
+
+    // Terminate both vectors
+    g_ptr_array_add(envv, NULL);
+    Environment *environment = new_environment((gchar **) g_ptr_array_free(envv, FALSE), TRUE, request, g_free);
+    environment->log = daemon_log_policy;
+    environment->log.directory = g_strdup(daemon_log_policy.directory);
+    g_ptr_array_add(argv, NULL);
+    gchar **command = (gchar **) g_ptr_array_free(argv, FALSE);
+
+    // Without a command the client's shell is run
+    if (!command[0]) {
+        g_strfreev(command);
+        command = get_shell_argv(environment);
+    }
+
+    // Open a window of its own for the client, which has already gone away
+    WindowData *window_data = create_terminal_window();
+    window_data->detach = daemon_detach;
+    hold_application_for_window(window_data->window);
+
+    open_terminal_tab(window_data, cwd ? cwd : g_get_home_dir(), command, environment);
+}
+
+static void daemon_request_received(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GMemoryOutputStream *request = G_MEMORY_OUTPUT_STREAM(source_object);
+    GSocketConnection *connection = user_data;
+    GError *error = NULL;
+
+    // The whole request has been read once the client shut down its end
+    if (g_output_stream_splice_finish(G_OUTPUT_STREAM(request), result, &error) < 0) {
+        g_warning("Unable to read illumiterm-client request: %s", error->message);
+        g_error_free(error);
+    } else {
+        gsize length = g_memory_output_stream_get_data_size(request);
+        open_daemon_request(g_memory_output_stream_steal_data(request), length);
+    }
+
+    g_object_unref(request);
+    g_object_unref(connection);
+}
+
+static gboolean daemon_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    // Read the request into memory without blocking the main loop
+    GOutputStream *request = g_memory_output_stream_new_resizable();
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+
+    g_output_stream_splice_async(request, input, G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                 G_PRIORITY_DEFAULT, NULL, daemon_request_received, g_object_ref(connection));
+
+    return TRUE;
+}
+
+static void stop_daemon(GApplication *application, gpointer user_data) {
+    // Remove the socket so clients fall back right away instead of trying a dead daemon
+    if (daemon_service) {
+        g_socket_service_stop(daemon_service);
+        g_socket_listener_close(G_SOCKET_LISTENER(daemon_service));
+        g_unlink(daemon_socket_path);
+        g_clear_object(&daemon_service);
+        g_clear_pointer(&daemon_socket_path, g_free);
+    }
+}
+
+static void start_daemon(GApplication *application, gboolean detach, GVariantDict *options) {
+    // A second --daemon reaches the running daemon and only says whether the windows it opens from now on detach,
+    // and how they log
+    daemon_detach = detach;
+    g_free(daemon_log_policy.directory);
+    daemon_log_policy = default_log_policy;
+    apply_log_options(&daemon_log_policy, options);
+    if (daemon_service) {
+        return;
+    }
+
+    daemon_socket_path = g_build_filename(g_get_user_runtime_dir(), DAEMON_SOCKET_NAME, NULL);
+
+    // This is the primary instance, so a socket left at the path belongs to a daemon that is gone
+    g_unlink(daemon_socket_path);
+
+    GSocketAddress *address = g_unix_socket_address_new(daemon_socket_path);
+    GError *error = NULL;
+    daemon_service = g_socket_service_new();
+
+    // Only this user may ask the daemon to run commands
+    mode_t mask = umask(0177);
+    gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(daemon_service), address, G_SOCKET_TYPE_STREAM,
+                                                       G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error);
+    umask(mask);
+    g_object_unref(address);
+
+    if (!listening) {
+        g_warning("Unable to listen on %s: %s", daemon_socket_path, error->message);
+        g_error_free(error);
+        g_clear_object(&daemon_service);
+        g_clear_pointer(&daemon_socket_path, g_free);
+        return;
+    }
+
+    g_signal_connect(daemon_service, "incoming", G_CALLBACK(daemon_incoming), NULL);
+    g_signal_connect(application, "shutdown", G_CALLBACK(stop_daemon), NULL);
+    g_socket_service_start(daemon_service);
+
+    // Keep running without any window until the session ends
+    g_application_hold(application);
+}
+
+// A window of the last session, and the tabs it had in order
+typedef struct {
+    gint width;
+    gint height;
+    GArray *tabs;
+} SessionWindow;
+
+// A tab of the last session
+typedef struct {
+    guint32 window;
+    gchar *cwd;
+    gchar **argv;
+    gchar *name;
+    GArray *chunks;
+} SessionTab;
+
+static void free_session_window(gpointer user_data) {
+    SessionWindow *window = user_data;
+
+    g_array_unref(window->tabs);
+    g_free(window);
+}
+
+static void free_session_tab(gpointer user_data) {
+    SessionTab *tab = user_data;
+
+    g_free(tab->cwd);
+    g_strfreev(tab->argv);
+    g_free(tab->name);
+    g_array_unref(tab->chunks);
+    g_free(tab);
+}
+
+static gboolean read_session_u32(const guint8 **position, const guint8 *end, guint32 *value) {
+    if (end - *position < (gssize) sizeof(*value)) {
+        return FALSE;
+    }
+
+    memcpy(value, *position, sizeof(*value));
+    *value = GUINT32_FROM_LE(*value);
+    *position += sizeof(*value);
+    return TRUE;
+}
+
+static const gchar* read_session_string(const guint8 **position, const guint8 *end) {
+    const guint8 *nul = memchr(*position, '\0', end - *position);
+    const gchar *value = (const gchar *) *position;
+
+    if (!nul) {
+        return NULL;
+    }
+
+    *position = nul + 1;
+    return value;
+}
+
+static void remove_session_tab(GHashTable *saved_windows, GHashTable *saved_tabs, guint32 id) {
+    SessionTab *tab = g_hash_table_lookup(saved_tabs, GUINT_TO_POINTER(id));
+    SessionWindow *window = tab ? g_hash_table_lookup(saved_windows, GUINT_TO_POINTER(tab->window)) : NULL;
+
+    for (guint i = 0; window && i < window->tabs->len; ++i) {
+        if (g_array_index(window->tabs, guint32, i) == id) {
+            g_array_remove_index(window->tabs, i);
+            break;
+        }
+    }
+    g_hash_table_remove(saved_tabs, GUINT_TO_POINTER(id));
+}
+
+static void reorder_session_tabs(SessionWindow *window, const guint8 *position, const guint8 *end) {
+    GArray *reordered = g_array_new(FALSE, FALSE, sizeof(guint32));
+    guint32 id;
+
+    // Take the listed tabs in their new order, then whatever the record does not know about
+    while (read_session_u32(&position, end, &id)) {
+        for (guint i = 0; i < window->tabs->len; ++i) {
+            if (g_array_index(window->tabs, guint32, i) == id) {
+                g_array_append_val(reordered, id);
+                g_array_remove_index(window->tabs, i);
+                break;
+            }
+        }
+    }
+    g_array_append_vals(reordered, window->tabs->data, window->tabs->len);
+
+    g_array_unref(window->tabs);
+    window->tabs = reordered;
+}
+
+static void read_session(const guint8 *contents, gsize length, GHashTable *saved_windows, GHashTable *saved_tabs, GArray *window_order) {
+    const guint8 *end = contents + length;
+
+    // Replay the records; a record cut short by a crash ends the log
+    for (const guint8 *record = contents + strlen(SESSION_MAGIC); end - record >= 5; ) {
+        guint32 payload_length;
+        const guint8 *position = record + 1;
+        read_session_u32(&position, end, &payload_length);
+        if ((gsize) (end - position) < payload_length) {
+            break;
+        }
+
+        const guint8 *payload_end = position + payload_length;
+        guint32 id, window_id, width, height, text_length;
+        SessionWindow *window;
+        SessionTab *tab;
+
+        switch (record[0]) {
+            case 'W':
+                if (!read_session_u32(&position, payload_end, &id) || !read_session_u32(&position, payload_end, &width) ||
+                    !read_session_u32(&position, payload_end, &height)) {
+                    break;
+                }
+                window = g_hash_table_lookup(saved_windows, GUINT_TO_POINTER(id));
+                if (!window) {
+                    window = g_new0(SessionWindow, 1);
+                    window->tabs = g_array_new(FALSE, FALSE, sizeof(guint32));
+                    g_hash_table_insert(saved_windows, GUINT_TO_POINTER(id), window);
+                    g_array_append_val(window_order, id);
+                }
+                window->width = width;
+                window->height = height;
+                break;
+
+            case 'X':
+                if (read_session_u32(&position, payload_end, &id)) {
+                    g_hash_table_remove(saved_windows, GUINT_TO_POINTER(id));
+                }
+                break;
+
+            case 'T': {
+                if (!read_session_u32(&position, payload_end, &id) || !read_session_u32(&position, payload_end, &window_id)) {
+                    break;
+                }
+                window = g_hash_table_lookup(saved_windows, GUINT_TO_POINTER(window_id));
+                const gchar *cwd = read_session_string(&position, payload_end);
+                if (!window || !cwd) {
+                    break;
+                }
+
+                GPtrArray *argv = g_ptr_array_new();
+                for (const gchar *argument; (argument = read_session_string(&position, payload_end)); ) {
+                    g_ptr_array_add(argv, g_strdup(argument));
+                }
+                g_ptr_array_add(argv, NULL);
+
+                tab = g_hash_table_lookup(saved_tabs, GUINT_TO_POINTER(id));
+                if (!tab) {
+                    tab = g_new0(SessionTab, 1);
+                    tab->window = window_id;
+                    tab->chunks = g_array_new(FALSE, FALSE, sizeof(SessionChunk));
+                    g_hash_table_insert(saved_tabs, GUINT_TO_POINTER(id), tab);
+                    g_array_append_val(window->tabs, id);
+                }
+                g_free(tab->cwd);
+                g_strfreev(tab->argv);
+                tab->cwd = g_strdup(cwd);
+                tab->argv = (gchar **) g_ptr_array_free(argv, FALSE);
+                break;
+            }
+
+            case 'N':
+                if (read_session_u32(&position, payload_end, &id) && (tab = g_hash_table_lookup(saved_tabs, GUINT_TO_POINTER(id)))) {
+                    const gchar *name = read_session_string(&position, payload_end);
+                    g_free(tab->name);
+                    tab->name = name && *name ? g_strdup(name) : NULL;
+                }
+                break;
+
+            case 'O':
+                if (read_session_u32(&position, payload_end, &id) && (window = g_hash_table_lookup(saved_windows, GUINT_TO_POINTER(id)))) {
+                    reorder_session_tabs(window, position, payload_end);
+                }
+                break;
+
+            case 'C':
+                if (read_session_u32(&position, payload_end, &id)) {
+                    remove_session_tab(saved_windows, saved_tabs, id);
+                }
+                break;
+
+            case 'H':
+                if (read_session_u32(&position, payload_end, &id) && read_session_u32(&position, payload_end, &text_length) &&
+                    (tab = g_hash_table_lookup(saved_tabs, GUINT_TO_POINTER(id)))) {
+                    SessionChunk chunk = { record - contents, payload_end - record, text_length };
+                    g_array_append_val(tab->chunks, chunk);
+                }
+                break;
+        }
+
+        record = payload_end;
+    }
+}
+
+static guint restore_session(Environment *environment, gboolean detach) {
+    GMappedFile *file = g_mapped_file_new(session_path, FALSE, NULL);
+    guint restored = 0;
+
+    // No log yet, nothing to restore
+    if (!file) {
+        return 0;
+    }
+
+    const guint8 *contents = (const guint8 *) g_mapped_file_get_contents(file);
+    gsize length = g_mapped_file_get_length(file);
+
+    if (length < strlen(SESSION_MAGIC) || memcmp(contents, SESSION_MAGIC, strlen(SESSION_MAGIC)) != 0) {
+        g_warning("Ignoring %s, it is not an IllumiTerm session", session_path);
+        g_mapped_file_unref(file);
+        return 0;
+    }
+
+    GHashTable *saved_windows = g_hash_table_new_full(NULL, NULL, NULL, free_session_window);
+    GHashTable *saved_tabs = g_hash_table_new_full(NULL, NULL, NULL, free_session_tab);
+    GArray *window_order = g_array_new(FALSE, FALSE, sizeof(guint32));
+    read_session(contents, length, saved_windows, saved_tabs, window_order);
+
+    for (guint i = 0; i < window_order->len; ++i) {
+        SessionWindow *window = g_hash_table_lookup(saved_windows, GUINT_TO_POINTER(g_array_index(window_order, guint32, i)));
+        if (!window || window->tabs->len == 0) {
+            continue;
+        }
+
+        // Open the window at its old size
+        WindowData *window_data = create_terminal_window();
+        window_data->detach = detach;
+        hold_application_for_window(window_data->window);
+        gtk_window_resize(GTK_WINDOW(window_data->window), MAX(window->width, 1), MAX(window->height, 1));
+
+        // Re-create its tabs; only the first one shown starts its terminal, and with it loads its history
+        for (guint j = 0; j < window->tabs->len; ++j) {
+            SessionTab *tab = g_hash_table_lookup(saved_tabs, GUINT_TO_POINTER(g_array_index(window->tabs, guint32, j)));
+            gchar **argv = tab->argv && *tab->argv ? g_strdupv(tab->argv) : get_shell_argv(environment);
+            const gchar *cwd = g_file_test(tab->cwd, G_FILE_TEST_IS_DIR) ? tab->cwd : g_get_home_dir();
+            TerminalData *data = new_terminal_data(cwd, argv, ref_environment(environment));
+
+            data->custom_title = g_strdup(tab->name);
+            data->session_chunks = g_array_ref(tab->chunks);
+            attach_terminal_tab(window_data, data);
+        }
+
+        restored++;
+    }
+
+    g_array_unref(window_order);
+    g_hash_table_unref(saved_tabs);
+    g_hash_table_unref(saved_windows);
+    g_mapped_file_unref(file);
+
+    return restored;
+}
+
+static void copy_session_history(TerminalData *data, const guint8 *contents, gsize length) {
+    GArray *chunks = data->session_chunks;
+    guint first = chunks ? chunks->len : 0;
+
+    // Keep the most recent chunks, up to the history limit
+    for (gsize text_length = 0; first > 0; --first) {
+        text_length += g_array_index(chunks, SessionChunk, first - 1).text_length;
+        if (text_length > SESSION_HISTORY_LIMIT) {
+            break;
+        }
+    }
+
+    // Copy them over unchanged and note where they are now
+    GArray *copied = g_array_new(FALSE, FALSE, sizeof(SessionChunk));
+    for (guint i = first; chunks && i < chunks->len; ++i) {
+        SessionChunk chunk = g_array_index(chunks, SessionChunk, i);
+
+        if (!contents || chunk.offset + chunk.length > length) {
+            continue;
+        }
+        g_byte_array_append(session_buffer, contents + chunk.offset, chunk.length);
+        chunk.offset = session_size + session_buffer->len - chunk.length;
+        g_array_append_val(copied, chunk);
+    }
+
+    if (chunks) {
+        g_array_unref(chunks);
+    }
+    data->session_chunks = copied;
+}
+
+static gboolean compact_session() {
+    // Everything recorded so far has to be in the old log to be copied from it
+    flush_session();
+
+    gchar *new_path = g_strconcat(session_path, ".new", NULL);
+    gint fd = open(new_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_warning("Unable to write the session to %s: %s", new_path, g_strerror(errno));
+        g_free(new_path);
+        return FALSE;
+    }
+
+    GMappedFile *file = g_mapped_file_new(session_path, FALSE, NULL);
+    const guint8 *contents = file ? (const guint8 *) g_mapped_file_get_contents(file) : NULL;
+    gsize length = file ? g_mapped_file_get_length(file) : 0;
+
+    // Continue with the new log, starting with the current state of every window
+    if (session_fd >= 0) {
+        close(session_fd);
+    }
+    session_fd = fd;
+    session_size = 0;
+    g_byte_array_append(session_buffer, (const guint8 *) SESSION_MAGIC, strlen(SESSION_MAGIC));
+
+    for (GList *item = windows; item; item = item->next) {
+        WindowData *window_data = item->data;
+        GtkNotebook *notebook = GTK_NOTEBOOK(window_data->notebook);
+        record_session_window(window_data);
+
+        for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); ++i) {
+            TerminalData *data = g_object_get_data(G_OBJECT(gtk_notebook_get_nth_page(notebook, i)), "terminal-data");
+
+            record_session_tab(data);
+            if (data->custom_title) {
+                record_session_tab_name(data);
+            }
+            copy_session_history(data, contents, length);
+            flush_session();
+        }
+    }
+    flush_session();
+
+    if (file) {
+        g_mapped_file_unref(file);
+    }
+
+    // Replace the old log in one step, so that a crash leaves one or the other
+    gboolean replaced = session_fd >= 0 && g_rename(new_path, session_path) == 0;
+    if (!replaced) {
+        g_warning("Unable to replace the session %s", session_path);
+    }
+    session_compacted_size = session_size;
+
+    g_free(new_path);
+    return replaced;
+}
+
+static void stop_session(GApplication *application, gpointer user_data) {
+    // Write what is still buffered; the log is complete after every record
+    flush_session();
+
+    if (session_fd >= 0) {
+        close(session_fd);
+        session_fd = -1;
+    }
+}
+
+static gboolean start_session(GApplication *application, Environment *environment, gboolean history, gboolean detach) {
+    // Recording history can be switched on later, the rest happens once per process
+    session_history_enabled |= history;
+    if (session_enabled) {
+        return FALSE;
+    }
+    session_enabled = TRUE;
+
+    gchar *directory = g_build_filename(g_get_user_data_dir(), "illumiterm", NULL);
+    g_mkdir_with_parents(directory, 0700);
+    session_path = g_build_filename(directory, "session", NULL);
+    session_buffer = g_byte_array_new();
+    g_free(directory);
+
+    // Reopen the windows of the last session, then start a fresh log holding just them
+    guint restored = restore_session(environment, detach);
+    compact_session();
+    g_signal_connect(application, "shutdown", G_CALLBACK(stop_session), NULL);
+
+    return restored > 0;
+}
+
+static void command_line_export_finished(GError *error, gpointer user_data) {
+    GApplicationCommandLine *cli = user_data;
+
+    // The invoking process exits once the command line is released
+    if (error) {
+        g_application_command_line_printerr(cli, "illumiterm: %s\n", error->message);
+        g_application_command_line_set_exit_status(cli, EXIT_FAILURE);
+    }
+    g_object_unref(cli);
+}
+
+static void export_scrollback_from_cli(GApplicationCommandLine *cli, const gchar *target, const gchar *format_name) {
+    // The target is the terminal number, a colon and the file, relative to the invoking process' directory
+    gchar *end = NULL;
+    guint64 id = g_ascii_strtoull(target, &end, 10);
+    TerminalData *data = end != target && *end == ':' ? find_terminal(id) : NULL;
+    ExportFormat format;
+    GError *error = NULL;
+
+    if (end == target || *end != ':' || !end[1]) {
+        g_application_command_line_printerr(cli, "illumiterm: --export-scrollback takes ID:FILE\n");
+    } else if (!parse_export_format(format_name, &format)) {
+        g_application_command_line_printerr(cli, "illumiterm: unknown export format %s\n", format_name);
+    } else if (!data) {
+        g_application_command_line_printerr(cli, "illumiterm: no terminal %" G_GUINT64_FORMAT "\n", id);
+    } else {
+        GFile *file = g_application_command_line_create_file_for_arg(cli, end + 1);
+        gchar *path = g_file_get_path(file);
+        gboolean started = export_scrollback(data, path, format, command_line_export_finished, g_object_ref(cli), &error);
+
+        g_free(path);
+        g_object_unref(file);
+        if (started) {
+            return;
+        }
+
+        g_application_command_line_printerr(cli, "illumiterm: %s\n", error->message);
+        g_error_free(error);
+        g_object_unref(cli);
+    }
+
+    g_application_command_line_set_exit_status(cli, EXIT_FAILURE);
+}
+
+void command_line(GApplication *application, GApplicationCommandLine *cli, gpointer data) {
+    GVariantDict *options = g_application_command_line_get_options_dict(cli);
+
+    // Save the scrollback of a running terminal instead of opening a window
+    const gchar *export_target = NULL;
+    if (g_variant_dict_lookup(options, "export-scrollback", "&s", &export_target)) {
+        const gchar *export_format = NULL;
+        g_variant_dict_lookup(options, "export-format", "&s", &export_format);
+        export_scrollback_from_cli(cli, export_target, export_format);
+        return;
+    }
+
+    // Apply the memory budget given on this command line
+    apply_memory_options(cli, options);
+
+    // Record frame times in the windows opened from now on
+    if (g_variant_dict_contains(options, "frame-stats")) {
+        frame_stats_enabled = TRUE;
+    }
+
+    // Time keystrokes until their output is painted, reporting on exit and optionally on a socket
+    const gchar *latency_socket = NULL;
+    g_variant_dict_lookup(options, "trace-latency-socket", "^&ay", &latency_socket);
+    if (latency_socket || g_variant_dict_contains(options, "trace-latency")) {
+        start_latency_trace(application, latency_socket);
+    }
+
+    // Keep the terminals of the windows this command line opens running when they are closed
+    gboolean detach = g_variant_dict_contains(options, "detach");
+
+    // List the terminals --attach can open
+    if (g_variant_dict_contains(options, "list-detached")) {
+        print_detached_terminals(cli);
+        return;
+    }
+
+    // In daemon mode, serve illumiterm-client instead of opening a window
+    if (g_variant_dict_contains(options, "daemon")) {
+        start_daemon(application, detach, options);
+        return;
+    }
+
+    // Command to run in the first tab instead of the shell
+    const gchar *command = NULL;
+    g_variant_dict_lookup(options, "cmd", "&s", &command);
+
+    // Commands to run in one tab each
+    const gchar *batch = NULL;
+    gchar **batch_commands = NULL;
+    if (g_variant_dict_lookup(options, "batch", "^&ay", &batch)) {
+        if (command) {
+            g_application_command_line_printerr(cli, "illumiterm: --cmd and --batch cannot be combined\n");
+            g_application_command_line_set_exit_status(cli, EXIT_FAILURE);
+            return;
+        }
 
-    // Add label for the application name
-    GtkWidget *label = create_label_with_markup("<big><b>IllumiTerm</b></big>");
-    gtk_box_pack_start(GTK_BOX(about_tab), label, FALSE, FALSE, 0);
+        batch_commands = read_batch_commands(cli, batch);
+        if (!batch_commands) {
+            g_application_command_line_set_exit_status(cli, EXIT_FAILURE);
+            return;
+        }
+    }
 
-    // Add a separator
-    GtkWidget *separator = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(about_tab), separator, FALSE, FALSE, 0);
+    // Terminal to show again instead of starting a new one
+    TerminalData *attached = NULL;
+    gint attach_id;
+    if (g_variant_dict_lookup(options, "attach", "i", &attach_id)) {
+        attached = attach_id > 0 ? find_detached_terminal(attach_id) : NULL;
+        if (!attached) {
+            g_application_command_line_printerr(cli, "illumiterm: no detached terminal %d\n", attach_id);
+            print_detached_terminals(cli);
+            g_application_command_line_set_exit_status(cli, EXIT_FAILURE);
+            g_strfreev(batch_commands);
+            return;
+        }
+    }
 
-    // Add description label
-    GtkWidget *description = create_label_with_markup("<b>Programming has always fascinated me, and I have always been interested\n"
-                                                      "in learning new languages and exploring different software development tools.\n"
-                                                      "Recently, I decided to take my programming skills to the next level by learning C\n"
-                                                      "and creating my own custom terminal. It was a challenging yet rewarding experience\n"
-                                                      "that helped me develop my programming skills in many ways.\n"
-                                                      "\n"
-                                                      "My journey started with the decision to learn C. I had heard a lot about\n"
-                                                      "the language's speed, efficiency, and low-level programming capabilities,\n"
-                                                      "and I was excited to explore it. I started with the basics, such as data types,\n"
-                                                      "operators, and control statements, and gradually moved on to more advanced topics,\n"
-                                                      "such as pointers, structures, and file handling.</b>");
+    // One environment snapshot serves every tab opened by this command line
+    Environment *environment = get_environment(cli);
 
-    gtk_label_set_justify(GTK_LABEL(description), GTK_JUSTIFY_CENTER);
-    gtk_box_pack_start(GTK_BOX(about_tab), description, TRUE, TRUE, 0);
+    // Apply the variables set with --env on top of it
+    const gchar **overrides = NULL;
+    if (g_variant_dict_lookup(options, "env", "^a&s", &overrides)) {
+        Environment *overridden = override_environment(environment, overrides);
+        unref_environment(environment);
+        environment = overridden;
+        g_free(overrides);
+    }
 
-    // Add another separator
-    GtkWidget *separator1 = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(about_tab), separator1, FALSE, FALSE, 0);
+    // The scrollback and logging options go with the environment to every terminal opened from this command line
+    apply_scrollback_options(environment, options);
+    apply_log_options(&environment->log, options);
 
-    // Add a link button
-    GtkWidget *link_button = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
-    gtk_box_pack_start(GTK_BOX(about_tab), link_button, FALSE, FALSE, 0);
-    
-    // Add a label for the copyright notice
-    GtkWidget *copy = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
-    gtk_box_pack_end(GTK_BOX(about_tab), copy, FALSE, FALSE, 0);
-}
+    // Time the phases of opening this command line's window, or the first of a restored session
+    gboolean profiled = g_variant_dict_contains(options, "profile-startup") && start_startup_profile(cli);
+    gint64 build_start = g_get_monotonic_time();
+    if (profiled) {
+        startup_profile->start[STARTUP_WIDGET_BUILD] = build_start;
+    }
 
-void create_credits_tab(GtkWidget *notebook)
-{
-    // Create the "Credits" tab
-    GtkWidget *credits_tab = create_tab_with_label(notebook, "<b>Credits</b>");
+    // Reopen the windows of the last session; a command given as well still gets its own window
+    gboolean session_history = g_variant_dict_contains(options, "session-scrollback");
+    if ((session_history || g_variant_dict_contains(options, "session")) &&
+        start_session(application, environment, session_history, detach) && !command && !batch_commands && !attached) {
+        unref_environment(environment);
+        schedule_terminal_pool_refill();
+        return;
+    }
 
-    // Add logo image
-    GtkWidget *logo1 = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
-    gtk_box_pack_start(GTK_BOX(credits_tab), logo1, FALSE, FALSE, 0);
+    // Create the main window
+    WindowData *window_data = create_terminal_window();
+    GtkWidget* window = window_data->window;
+    window_data->detach = detach;
 
-    // Add label for the credits section
-    GtkWidget *credits_label = create_label_with_markup("<big><b>Credits</b></big>");
-    gtk_box_pack_start(GTK_BOX(credits_tab), credits_label, TRUE, TRUE, 0);
+    // Building the window ends where waiting for its first frame starts
+    if (profiled && startup_profile && !startup_profile->tab) {
+        startup_profile->end[STARTUP_WIDGET_BUILD] = startup_profile->start[STARTUP_FIRST_PAINT] = g_get_monotonic_time();
+    }
 
-    // Add a separator
-    GtkWidget *separator2 = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(credits_tab), separator2, FALSE, FALSE, 0);
+    // Hold a reference to the application
+    g_application_hold(application);
     
-    // Add credits list label
-    GtkWidget *credits_list = gtk_label_new("<b>Dear GTK and VTE developers,</b>\n\n"
-                                            "<b>Your attention to detail and commitment to open-source principles have made a\n"
-                                            "significant impact on the software development community as a whole.\n\n"
-                                            "Your contributions have helped countless developers around the world\n"
-                                            "to create high-quality, reliable applications that are accessible to everyone.</b>\n\n"
-                                            "<b>Thank you for all that you do. Your work is greatly appreciated and will continue to\n"
-                                            "make a positive difference in the world of software development for years to come.</b>\n\n"
-                                            "<b>Sincerely,</b>\n"
-                                            "<b>Elijah Gordon</b>");
-
-    gtk_label_set_use_markup(GTK_LABEL(credits_list), TRUE);
-    gtk_label_set_justify(GTK_LABEL(credits_list), GTK_JUSTIFY_CENTER);
-    gtk_box_pack_start(GTK_BOX(credits_tab), credits_list, FALSE, FALSE, 0);
+    // Set the application as data associated with the command-line object, and release it when done
+    g_object_set_data_full(G_OBJECT(cli), "application", application, (GDestroyNotify)g_application_release);
+    
+    // Set the command-line object as data associated with the window
+    g_object_set_data_full(G_OBJECT(window), "cli", cli, NULL);
+    
+    // Increase the reference count of the command-line object
+    g_object_ref(cli);
 
-    // Add another separator
-    GtkWidget *separator3 = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(credits_tab), separator3, FALSE, FALSE, 0);
+    if (attached) {
+        // Show the detached terminal in this window
+        reattach_terminal_tab(window_data, attached);
+    } else if (batch_commands) {
+        // Open the whole batch in this window
+        open_batch_tabs(window_data, cli, environment, batch_commands);
+        g_strfreev(batch_commands);
+    } else {
+        // Open the first tab with its terminal started right away
+        open_terminal_tab_from_cli(window_data, cli, environment, command);
+    }
+    unref_environment(environment);
 
-    // Add a label for the copyright notice
-    GtkWidget *copy = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
-    gtk_box_pack_end(GTK_BOX(credits_tab), copy, FALSE, FALSE, 0);
+    // An attached terminal is up already, only its first frame in the new window is left to time
+    if (profiled && attached) {
+        claim_startup_terminal(attached);
+    }
 
-    // Add a link button
-    GtkWidget *link_button1 = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
-    gtk_box_pack_start(GTK_BOX(credits_tab), link_button1, FALSE, FALSE, 0);
+    // Have terminals ready for New Window and New Tab once this window is up
+    schedule_terminal_pool_refill();
 }
 
-void create_license_tab(GtkWidget *notebook)
-{
-    // Create the "License" tab
-    GtkWidget *license_tab = create_tab_with_label(notebook, "<b>License</b>");
+static const GOptionEntry option_entries[] = {
+    { "scrollback-lines", 0, 0, G_OPTION_ARG_INT, NULL, "Number of scrollback lines kept in memory per terminal (-1 for as many as the memory cap allows)", "LINES" },
+    { "scrollback-spill", 0, 0, G_OPTION_ARG_NONE, NULL, "Also write lines leaving the screen to a compressed file on disk", NULL },
+    { "scrollback-memory-cap", 0, 0, G_OPTION_ARG_INT, NULL, "Memory budget for the scrollback of all terminals together", "MIB" },
+    { "memory-trim-floor", 0, 0, G_OPTION_ARG_INT, NULL, "Scrollback lines idle background terminals keep when memory is critically low (default 1000)", "LINES" },
+    { "cmd", 0, 0, G_OPTION_ARG_STRING, NULL, "Command line to run instead of the shell", "COMMAND" },
+    { "batch", 0, 0, G_OPTION_ARG_FILENAME, NULL, "Open one tab per command line in FILE, all in one window", "FILE" },
+    { "env", 0, 0, G_OPTION_ARG_STRING_ARRAY, NULL, "Set an environment variable for the terminals, or remove it when given without a value (may be repeated)", "NAME[=VALUE]" },
+    { "frame-stats", 0, 0, G_OPTION_ARG_NONE, NULL, "Print the frame time distribution of each window when it is closed", NULL },
+    { "profile-startup", 0, 0, G_OPTION_ARG_NONE, NULL, "Print how long each phase of opening the window took, up to its first frame", NULL },
+    { "trace-latency", 0, 0, G_OPTION_ARG_NONE, NULL, "Time keystrokes until their output is painted and print the latency histograms on exit", NULL },
+    { "trace-latency-socket", 0, 0, G_OPTION_ARG_FILENAME, NULL, "Like --trace-latency, also serving the current histograms to every connection on the Unix socket PATH", "PATH" },
+    { "session", 0, 0, G_OPTION_ARG_NONE, NULL, "Reopen the windows and tabs of the last session, and record them for the next one", NULL },
+    { "session-scrollback", 0, 0, G_OPTION_ARG_NONE, NULL, "Like --session, also keeping the scrollback of every tab", NULL },
+    { "daemon", 0, 0, G_OPTION_ARG_NONE, NULL, "Keep running in the background and open windows for illumiterm-client", NULL },
+    { "detach", 0, 0, G_OPTION_ARG_NONE, NULL, "Keep the terminals of the windows opened by this command running when they are closed, to be opened again with --attach", NULL },
+    { "attach", 0, 0, G_OPTION_ARG_INT, NULL, "Open the detached terminal ID in a new window", "ID" },
+    { "list-detached", 0, 0, G_OPTION_ARG_NONE, NULL, "List the detached terminals with their IDs and titles", NULL },
+    { "export-scrollback", 0, 0, G_OPTION_ARG_STRING, NULL, "Save the scrollback of the running terminal numbered ID (see the stats interface) to FILE, gzip-compressed if it ends in .gz", "ID:FILE" },
+    { "export-format", 0, 0, G_OPTION_ARG_STRING, NULL, "Format of --export-scrollback: text (default), ansi or html", "FORMAT" },
+    { "log-dir", 0, 0, G_OPTION_ARG_FILENAME, NULL, "Log the output of every terminal this invocation opens to files in DIR", "DIR" },
+    { "log-input", 0, 0, G_OPTION_ARG_NONE, NULL, "Also log what is typed and pasted into the terminals", NULL },
+    { "log-compress", 0, 0, G_OPTION_ARG_NONE, NULL, "Write gzip-compressed logs", NULL },
+    { "log-rotate-size", 0, 0, G_OPTION_ARG_INT, NULL, "Start a new log file after this much output, 0 for no limit (default 64)", "MIB" },
+    { "log-rotate-time", 0, 0, G_OPTION_ARG_INT, NULL, "Start a new log file after this long, 0 for no limit (default 60)", "MINUTES" },
+    { NULL }
+};
+
+// Interfaces exported next to the application's own on its D-Bus object path
+static const gchar stats_introspection_xml[] =
+    "<node>"
+    "  <interface name='SLcK.IllumiTerm.Stats'>"
+    "    <method name='GetTerminalStats'>"
+    "      <arg type='aa{sv}' name='terminals' direction='out'/>"
+    "    </method>"
+    "    <method name='GetProcessStats'>"
+    "      <arg type='a{sv}' name='stats' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "  <interface name='SLcK.IllumiTerm.Scrollback'>"
+    "    <method name='Export'>"
+    "      <arg type='u' name='terminal' direction='in'/>"
+    "      <arg type='s' name='path' direction='in'/>"
+    "      <arg type='s' name='format' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+static guint64 get_process_rss(GPid pid) {
+    // The second field of statm is the resident set size in pages
+    gchar *path = g_strdup_printf("/proc/%d/statm", pid);
+    gchar *contents = NULL;
+    guint64 pages = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        sscanf(contents, "%*u %" G_GUINT64_FORMAT, &pages);
+        g_free(contents);
+    }
+    g_free(path);
 
-    // Add a label for the copyright notice
-    GtkWidget *copy1 = create_label_with_markup("<b>Copyright (C) 2023 Elijah Gordon (SLcK)</b>");
-    gtk_box_pack_end(GTK_BOX(license_tab), copy1, FALSE, FALSE, 0);
+    return pages * sysconf(_SC_PAGESIZE);
+}
 
-    // Add logo image
-    GtkWidget *logo2 = create_image("/usr/share/icons/hicolor/96x96/apps/about.png");
-    gtk_box_pack_start(GTK_BOX(license_tab), logo2, FALSE, FALSE, 0);
+// Part of its budget a background terminal keeps on a low memory warning
+#define MEMORY_TRIM_DIVISOR 4
 
-    // Add label for the license section
-    GtkWidget *license_label = create_label_with_markup("<big><b>License</b></big>");
-    gtk_box_pack_start(GTK_BOX(license_tab), license_label, FALSE, FALSE, 0);
+// Source of the memory warnings, and what they did: warnings received, background terminals whose
+// scrollback was spilled and shrunk, caches dropped and idle terminals trimmed to the floor
+static GMemoryMonitor *memory_monitor = NULL;
+static guint64 memory_warnings = 0;
+static guint64 memory_scrollback_trims = 0;
+static guint64 memory_cache_drops = 0;
+static guint64 memory_history_trims = 0;
 
-    // Add a separator
-    GtkWidget *separator4 = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(license_tab), separator4, FALSE, FALSE, 0);
-    
-    // Add license description label
-    GtkWidget *license_description = gtk_label_new("<b>This program is free software; you can redistribute it and/or\n"
-                                                   "modify it under the terms of the GNU General Public License\n"
-                                                   "as published by the Free Software Foundation; either version 2\n"
-                                                   "of the License, or (at your option) any later version.</b>\n\n"
-                                                   "<b>This program is distributed in the hope that it will be useful,\n"
-                                                   "but WITHOUT ANY WARRANTY; without even the implied warranty of\n"
-                                                   "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
-                                                   "GNU General Public License for more details.</b>\n\n"
-                                                   "<b>You should have received a copy of the GNU General Public License\n"
-                                                   "along with this program; if not, write to the Free Software\n"
-                                                   "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.</b>");
+static gboolean is_background_terminal(TerminalData *data) {
+    // Terminals that are not rendered, in hidden tabs, minimized windows, the pool or detached
+    return data->terminal && (data->throttled || !data->window);
+}
 
-    gtk_label_set_use_markup(GTK_LABEL(license_description), TRUE);
-    gtk_label_set_justify(GTK_LABEL(license_description), GTK_JUSTIFY_CENTER);
-    gtk_box_pack_start(GTK_BOX(license_tab), license_description, FALSE, FALSE, 0);
+static void trim_background_scrollback(gboolean critical) {
+    for (GList *item = terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+        glong lines = critical ? MAX(memory_trim_floor, 1) : MAX(data->scrollback_lines / MEMORY_TRIM_DIVISOR, SCROLLBACK_MIN_LINES);
 
-    // Add another separator
-    GtkWidget *separator5 = create_separator(GTK_ORIENTATION_HORIZONTAL);
-    gtk_box_pack_start(GTK_BOX(license_tab), separator5, FALSE, FALSE, 0);
+        // Down to the floor only terminals whose shell sits at its prompt, others keep what they are producing
+        if (!is_background_terminal(data) || (critical && is_terminal_busy(data)) ||
+            (data->scrollback_limit && data->scrollback_limit <= lines)) {
+            continue;
+        }
 
-    // Add a link button
-    GtkWidget *link_button2 = create_link_button("https://illumiterm.blogspot.com", "Visit Website");
-    gtk_box_pack_start(GTK_BOX(license_tab), link_button2, FALSE, FALSE, 0);
+        // Write the rows about to go to the spill file first, opening one for the terminal if needed
+        if (!data->spill_file) {
+            open_spill_file(data);
+        }
+        data->scrollback_limit = lines;
+        if (critical) {
+            memory_history_trims++;
+        } else {
+            memory_scrollback_trims++;
+        }
+    }
+
+    rebalance_scrollback();
 }
 
-void create_about_window(GtkWindow *parent)
-{
-    // Create the about window
-    GtkWidget *about_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    set_window_properties(about_window, "About IllumiTerm", parent, TRUE, FALSE);
+static void drop_memory_caches() {
+    // Cell sizes are measured again when used
+    if (font_metrics_cache) {
+        g_hash_table_remove_all(font_metrics_cache);
+    }
 
-    // Create a header bar for the about window
-    GtkWidget *header = create_header_bar("About IllumiTerm");
-    gtk_window_set_titlebar(GTK_WINDOW(about_window), header);
+    // Search snapshots of background terminals are taken again by their next search
+    for (GList *item = terminals; item; item = item->next) {
+        TerminalData *data = item->data;
+        WindowData *window_data = data->window ? get_window_data(data->window) : NULL;
 
-    // Create a notebook widget to hold the tabs
-    GtkWidget *notebook = gtk_notebook_new();
-    gtk_container_add(GTK_CONTAINER(about_window), notebook);
+        if (data->search_index && is_background_terminal(data) &&
+            !(window_data && window_data->search_job && window_data->search_job->index == data->search_index)) {
+            g_hash_table_remove_all(data->search_index->chunks);
+            data->search_index->end_row = 0;
+        }
+    }
 
-    // Create the "About" tab
-    create_about_tab(notebook);
+    // A hidden About window is built again when next opened
+    if (about_window && !gtk_widget_get_visible(about_window)) {
+        gtk_widget_destroy(about_window);
+    }
 
-    // Create the "Credits" tab
-    create_credits_tab(notebook);
+    memory_cache_drops++;
+}
 
-    // Create the "License" tab
-    create_license_tab(notebook);
+static void low_memory_warning(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer user_data) {
+    memory_warnings++;
 
-    // Show all widgets in the about window
-    gtk_widget_show_all(about_window);
+    // Give memory back in stages as the warnings get more severe: history is kept on disk first,
+    // then caches that can be rebuilt go, and finally history of idle terminals is dropped
+    trim_background_scrollback(FALSE);
+    if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM) {
+        drop_memory_caches();
+    }
+    if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL) {
+        trim_background_scrollback(TRUE);
+    }
 }
 
-void on_about_activate(GtkMenuItem *menuitem, gpointer user_data) {
-    // Cast the user data parameter to GtkWindow* type
-    GtkWindow* window = GTK_WINDOW(user_data);
-    
-    // Call the create_about_window function to create and show the About window
-    create_about_window(window);
+static void watch_memory() {
+    memory_monitor = g_memory_monitor_dup_default();
+    g_signal_connect(memory_monitor, "low-memory-warning", G_CALLBACK(low_memory_warning), NULL);
 }
 
-static GtkWidget* create_about_menu_item() {
-    // Create a new menu item with the label "About"
-    GtkWidget* about_menu_item = gtk_menu_item_new_with_label("About");
-    
-    // Connect the "activate" signal of the menu item to the on_about_activate callback function
-    g_signal_connect(about_menu_item, "activate", G_CALLBACK(on_about_activate), NULL);
-    
-    // Return the created menu item
-    return about_menu_item;
+static GVariant* get_terminal_stats(TerminalData *data) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    // Rows held above the screen, and their size at the same per-cell estimate the memory cap uses
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(data->terminal));
+    glong columns = vte_terminal_get_column_count(data->terminal);
+    gint64 lines = MAX((gint64) (gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment))
+                       - vte_terminal_get_row_count(data->terminal), 0);
+
+    g_variant_builder_add(&builder, "{sv}", "id", g_variant_new_uint32(data->id));
+    g_variant_builder_add(&builder, "{sv}", "title", g_variant_new_string(get_tab_title(data)));
+    g_variant_builder_add(&builder, "{sv}", "scrollback-lines", g_variant_new_int64(lines));
+    g_variant_builder_add(&builder, "{sv}", "scrollback-bytes", g_variant_new_uint64(lines * columns * SCROLLBACK_BYTES_PER_CELL));
+    g_variant_builder_add(&builder, "{sv}", "pty-bytes-read", g_variant_new_uint64(data->output.bytes));
+    g_variant_builder_add(&builder, "{sv}", "frames-drawn", g_variant_new_uint64(data->frames_drawn));
+    g_variant_builder_add(&builder, "{sv}", "flooding", g_variant_new_boolean(data->flooding));
+    g_variant_builder_add(&builder, "{sv}", "rendering", g_variant_new_boolean(gtk_widget_get_mapped(GTK_WIDGET(data->terminal))));
+    g_variant_builder_add(&builder, "{sv}", "detached", g_variant_new_boolean(g_list_find(detached_terminals, data) != NULL));
+    g_variant_builder_add(&builder, "{sv}", "pooled", g_variant_new_boolean(g_queue_find(&terminal_pool, data) != NULL));
+    g_variant_builder_add(&builder, "{sv}", "child-pid", g_variant_new_int32(data->child_pid));
+    g_variant_builder_add(&builder, "{sv}", "child-rss", g_variant_new_uint64(data->child_pid ? get_process_rss(data->child_pid) : 0));
+    g_variant_builder_add(&builder, "{sv}", "scrollback-limit", g_variant_new_int64(data->scrollback_limit));
+    g_variant_builder_add(&builder, "{sv}", "logging", g_variant_new_boolean(data->log != NULL));
+    g_variant_builder_add(&builder, "{sv}", "log-dropped", g_variant_new_uint64(data->log ? get_log_dropped(data->log) : 0));
+
+    return g_variant_builder_end(&builder);
 }
 
-static GtkWidget* create_help_menu() {
-    // Create a new menu widget to hold the help menu items
-    GtkWidget* help_menu = gtk_menu_new();
-    
-    // Create the "About" menu item using the create_about_menu_item function
-    GtkWidget* about_menu_item = create_about_menu_item();
-    
-    // Append the "About" menu item to the help menu
-    gtk_menu_shell_append(GTK_MENU_SHELL(help_menu), about_menu_item);
-    
-    // Return the help menu
-    return help_menu;
+static GVariant* get_process_stats() {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    g_variant_builder_add(&builder, "{sv}", "terminals", g_variant_new_uint32(g_list_length(terminals)));
+    g_variant_builder_add(&builder, "{sv}", "title-updates", g_variant_new_uint64(title_updates_requested));
+    g_variant_builder_add(&builder, "{sv}", "title-updates-dropped", g_variant_new_uint64(title_updates_dropped));
+    g_variant_builder_add(&builder, "{sv}", "font-scales", g_variant_new_uint32(font_metrics_cache ? g_hash_table_size(font_metrics_cache) : 0));
+    g_variant_builder_add(&builder, "{sv}", "font-metrics-hits", g_variant_new_uint64(font_metrics_hits));
+    g_variant_builder_add(&builder, "{sv}", "memory-warnings", g_variant_new_uint64(memory_warnings));
+    g_variant_builder_add(&builder, "{sv}", "memory-scrollback-trims", g_variant_new_uint64(memory_scrollback_trims));
+    g_variant_builder_add(&builder, "{sv}", "memory-cache-drops", g_variant_new_uint64(memory_cache_drops));
+    g_variant_builder_add(&builder, "{sv}", "memory-history-trims", g_variant_new_uint64(memory_history_trims));
+    g_variant_builder_add(&builder, "{sv}", "rss", g_variant_new_uint64(get_process_rss(getpid())));
+
+    return g_variant_builder_end(&builder);
 }
 
-static GtkWidget* create_menu() {
-    // Create the menu bar
-    GtkWidget *menu_bar = gtk_menu_bar_new();
+static void stats_method_call(GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+                              const gchar *interface_name, const gchar *method_name, GVariant *parameters,
+                              GDBusMethodInvocation *invocation, gpointer user_data) {
+    if (g_strcmp0(method_name, "GetTerminalStats") == 0) {
+        // One dictionary per started terminal, then one per pooled terminal, which may have its shell running
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+        for (GList *item = terminals; item; item = item->next) {
+            g_variant_builder_add_value(&builder, get_terminal_stats(item->data));
+        }
+        for (GList *item = terminal_pool.head; item; item = item->next) {
+            g_variant_builder_add_value(&builder, get_terminal_stats(item->data));
+        }
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(aa{sv})", &builder));
+    } else if (g_strcmp0(method_name, "GetProcessStats") == 0) {
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{sv})", get_process_stats()));
+    }
+}
 
-    // Create "File" menu item
-    GtkWidget *file_menu_item = gtk_menu_item_new_with_label("File");
-    GtkWidget *file_menu = create_file_menu();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), file_menu_item);
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(file_menu_item), file_menu);
-
-    // Create "Edit" menu item
-    GtkWidget *edit_menu_item = gtk_menu_item_new_with_label("Edit");
-    GtkWidget *edit_menu = create_edit_menu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(edit_menu_item), edit_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), edit_menu_item);
-
-    // Create "Tabs" menu item
-    GtkWidget *tabs_menu_item = gtk_menu_item_new_with_label("Tabs");
-    GtkWidget *tabs_menu = create_tabs_menu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(tabs_menu_item), tabs_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), tabs_menu_item);
-
-    // Create "Help" menu item
-    GtkWidget *help_menu_item = gtk_menu_item_new_with_label("Help");
-    GtkWidget *help_menu = create_help_menu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(help_menu_item), help_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), help_menu_item);
+static const GDBusInterfaceVTable stats_vtable = { stats_method_call, NULL, NULL };
 
-    // Return the menu bar
-    return menu_bar;
-}
+static void dbus_export_finished(GError *error, gpointer user_data) {
+    GDBusMethodInvocation *invocation = user_data;
 
-void set_notebook_show_tabs(GtkWidget* notebook) {
-    // Set the property to hide the tabs in the notebook
-    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
+    // The call returns once the file is complete
+    if (error) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+    } else {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    }
 }
 
-static GtkWidget* create_notebook(GtkWidget* widget) {
-    GtkWidget *notebook = gtk_notebook_new();
-    set_notebook_show_tabs(notebook);
+static void scrollback_method_call(GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+                                   const gchar *interface_name, const gchar *method_name, GVariant *parameters,
+                                   GDBusMethodInvocation *invocation, gpointer user_data) {
+    guint32 id;
+    const gchar *path, *format_name;
+    ExportFormat format;
+    GError *error = NULL;
+
+    g_variant_get(parameters, "(u&s&s)", &id, &path, &format_name);
+    TerminalData *data = find_terminal(id);
+
+    if (!parse_export_format(format_name, &format)) {
+        g_dbus_method_invocation_return_error(invocation, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown export format %s", format_name);
+    } else if (!data) {
+        g_dbus_method_invocation_return_error(invocation, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No terminal %u", id);
+    } else if (!g_path_is_absolute(path)) {
+        g_dbus_method_invocation_return_error(invocation, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "The path must be absolute");
+    } else if (!export_scrollback(data, path, format, dbus_export_finished, invocation, &error)) {
+        g_dbus_method_invocation_take_error(invocation, error);
+    }
+}
 
-    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+static const GDBusInterfaceVTable scrollback_vtable = { scrollback_method_call, NULL, NULL };
 
-    gtk_container_add(GTK_CONTAINER(scrolled_window), notebook);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_ALWAYS);
+static void export_stats(GApplication *application) {
+    GDBusConnection *connection = g_application_get_dbus_connection(application);
+    GError *error = NULL;
 
-    int widget_height = 1000;
-    gtk_widget_set_size_request(widget, 0, widget_height);
-    gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrolled_window), widget_height);
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), widget, NULL);
-    gtk_widget_show_all(scrolled_window);
+    // Without a session bus there is nobody to ask
+    if (!connection) {
+        return;
+    }
 
-    return scrolled_window;
+    GDBusNodeInfo *node = g_dbus_node_info_new_for_xml(stats_introspection_xml, NULL);
+    if (!g_dbus_connection_register_object(connection, g_application_get_dbus_object_path(application),
+                                           g_dbus_node_info_lookup_interface(node, "SLcK.IllumiTerm.Stats"), &stats_vtable, NULL, NULL, &error)) {
+        g_warning("Unable to export the stats interface: %s", error->message);
+        g_clear_error(&error);
+    }
+    if (!g_dbus_connection_register_object(connection, g_application_get_dbus_object_path(application),
+                                           g_dbus_node_info_lookup_interface(node, "SLcK.IllumiTerm.Scrollback"), &scrollback_vtable, NULL, NULL, &error)) {
+        g_warning("Unable to export the scrollback interface: %s", error->message);
+        g_error_free(error);
+    }
+    g_dbus_node_info_unref(node);
 }
 
-static GtkWidget* create_window(GtkWidget* menu_bar, GtkWidget* notebook) {
-    // Create a new top-level window
-    GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    
-    // Create a vertical box container to hold the menu bar and notebook
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    
-    // Create a scrolled window to contain the notebook
-    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
-
-    // Add the notebook widget to the scrolled window
-    gtk_container_add(GTK_CONTAINER(scrolled_window), notebook);
-    
-    // Set the scrolling policies of the scrolled window to automatic
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    
-    // Set the window icon from a file
-    gtk_window_set_icon_from_file(GTK_WINDOW(window), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
-    
-    // Pack the menu bar at the top of the vertical box container
-    gtk_box_pack_start(GTK_BOX(vbox), menu_bar, FALSE, FALSE, 0);
-    
-    // Pack the scrolled window, which contains the notebook, to fill the remaining space in the vertical box container
-    gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
-    
-    // Add the vertical box container to the window
-    gtk_container_add(GTK_CONTAINER(window), vbox);
-    
-    // Set the window title to NULL (empty)
-    gtk_window_set_title(GTK_WINDOW(window), NULL);
-    
-    // Set the default size of the window to 640x460 pixels
-    gtk_window_set_default_size(GTK_WINDOW(window), 640, 460);
-    
-    // Clear the window icon name
-    gtk_window_set_icon_name(GTK_WINDOW(window), NULL);
-    
-    // Show all the widgets within the window
-    gtk_widget_show_all(window);
-
-    // Return the created window
-    return window;
-}
+static void startup(GApplication *application, gpointer data) {
+    // The toolkit has just been initialized, ahead of this handler
+    gtk_init_time = g_get_monotonic_time();
 
-void command_line(GApplication *application, GApplicationCommandLine *cli, gpointer data) {
-    // Create a new VteTerminal widget
-    GtkWidget *widget = vte_terminal_new();
-    
-    // Create the menu bar
-    GtkWidget* menu_bar = create_menu();
-    
-    // Create the notebook
-    GtkWidget* notebook = create_notebook(widget);
-    
-    // Create the main window
-    GtkWidget* window = create_window(menu_bar, notebook);
+    // Read the configuration once for the primary instance, and again whenever it changes
+    GKeyFile *config = load_config();
+    load_keybindings(config);
+    parse_terminal_config(config, &terminal_config);
+    g_key_file_free(config);
+    watch_config();
 
-    // Hold a reference to the application
-    g_application_hold(application);
-    
-    // Set the application as data associated with the command-line object, and release it when done
-    g_object_set_data_full(G_OBJECT(cli), "application", application, (GDestroyNotify)g_application_release);
-    
-    // Set the command-line object as data associated with the window
-    g_object_set_data_full(G_OBJECT(window), "cli", cli, NULL);
-    
-    // Increase the reference count of the command-line object
-    g_object_ref(cli);
+    // Let other processes query the resource use of the terminals
+    export_stats(application);
 
-    // Spawn a new VteTerminal process asynchronously
-    spawn_vte_terminal(cli, window, widget);
+    // Give memory back when the system runs low
+    watch_memory();
 }
 
 static void connect_signals(GtkApplication* application) {
+    // Connect the "startup" signal, emitted in the primary instance only, to the "startup" callback function
+    g_signal_connect(application, "startup", G_CALLBACK(startup), NULL);
+
     // Connect the "command-line" signal of the GtkApplication to the "command_line" callback function
     g_signal_connect(application, "command-line", G_CALLBACK(command_line), NULL);
 }
@@ -1216,6 +8012,9 @@ static int run_application(int argc, char **argv) {
     // Create a new GtkApplication with the specified application ID
     GtkApplication *application = gtk_application_new("SLcK.IllumiTerm", G_APPLICATION_HANDLES_COMMAND_LINE | G_APPLICATION_SEND_ENVIRONMENT);
     
+    // Register the command line options understood by the application
+    g_application_add_main_option_entries(G_APPLICATION(application), option_entries);
+
     // Connect signals and set up event handlers for the application
     connect_signals(application);
     
@@ -1230,6 +8029,9 @@ static int run_application(int argc, char **argv) {
 }
 
 int main(int argc, char **argv) {
+    // Where --profile-startup counts from
+    process_start_time = g_get_monotonic_time();
+
     // Run the application and store the exit status in the 'status' variable
     int status = run_application(argc, argv);
 